@@ -0,0 +1,156 @@
+/**
+ * CRC-32C (Castagnoli) for --verify=crc32c.
+ *
+ * The implementation is chosen once at run time: the SSE4.2 crc32 instruction
+ * on x86-64 when the CPU has it, the ARMv8 CRC32 instructions when the
+ * compiler targets them, and a slicing-by-8 table everywhere else. Every
+ * implementation produces the same value, so checksums from different
+ * machines can be compared.
+ */
+
+#ifndef XORMOVE_CHECKSUMS_H
+#define XORMOVE_CHECKSUMS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define XMV_CRC32C_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <nmmintrin.h>
+#define XMV_CRC32C_TARGET
+#else
+#include <nmmintrin.h>
+#define XMV_CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define XMV_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace xmvsum {
+
+using Crc32cTables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+// Reflected CRC-32C tables; table k advances a byte through k further zero bytes
+inline const Crc32cTables& crc32cTables() {
+    static const Crc32cTables tables = []() {
+        Crc32cTables t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+            }
+            t[0][i] = crc;
+        }
+        for (std::size_t k = 1; k < t.size(); ++k) {
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+        return t;
+    }();
+    return tables;
+}
+
+inline std::uint32_t loadLittleEndian32(const unsigned char* p) {
+    return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+           (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+// Portable slicing-by-8. Pass the previous result (0 to start) to continue a checksum.
+inline std::uint32_t crc32cSoftware(std::uint32_t crc, const char* data, std::size_t length) {
+    const Crc32cTables& t = crc32cTables();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    crc = ~crc;
+    while (length >= 8) {
+        std::uint32_t lo = crc ^ loadLittleEndian32(p);
+        std::uint32_t hi = loadLittleEndian32(p + 4);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(XMV_CRC32C_X86)
+// Only called once crc32cHardwareAvailable() has confirmed SSE4.2
+XMV_CRC32C_TARGET inline std::uint32_t crc32cHardware(std::uint32_t crc, const char* data, std::size_t length) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    std::uint64_t state = ~crc & 0xFFFFFFFFu;
+    while (length >= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        state = _mm_crc32_u64(state, word);
+        p += 8;
+        length -= 8;
+    }
+    std::uint32_t tail = static_cast<std::uint32_t>(state);
+    while (length-- > 0) {
+        tail = _mm_crc32_u8(tail, *p++);
+    }
+    return ~tail;
+}
+#elif defined(XMV_CRC32C_ARM)
+inline std::uint32_t crc32cHardware(std::uint32_t crc, const char* data, std::size_t length) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    crc = ~crc;
+    while (length >= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return ~crc;
+}
+#endif
+
+inline bool crc32cHardwareAvailable() {
+#if defined(XMV_CRC32C_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;   // ECX bit 20: SSE4.2
+#elif defined(XMV_CRC32C_X86)
+    return __builtin_cpu_supports("sse4.2");
+#elif defined(XMV_CRC32C_ARM)
+    return true;   // The build already requires the CRC32 extension
+#else
+    return false;
+#endif
+}
+
+using Crc32cFunction = std::uint32_t (*)(std::uint32_t, const char*, std::size_t);
+
+inline Crc32cFunction crc32cFunction() {
+#if defined(XMV_CRC32C_X86) || defined(XMV_CRC32C_ARM)
+    static const Crc32cFunction chosen = crc32cHardwareAvailable() ? crc32cHardware : crc32cSoftware;
+    return chosen;
+#else
+    return crc32cSoftware;
+#endif
+}
+
+// "hardware" or "software", for logs
+inline const char* crc32cImplementation() {
+    return crc32cFunction() == crc32cSoftware ? "software" : "hardware";
+}
+
+// CRC-32C of data, continuing from crc (0 to start)
+inline std::uint32_t crc32c(std::uint32_t crc, const char* data, std::size_t length) {
+    return crc32cFunction()(crc, data, length);
+}
+
+}  // namespace xmvsum
+
+#endif  // XORMOVE_CHECKSUMS_H
@@ -0,0 +1,306 @@
+/**
+ * I/O backends for the xormove swap engine.
+ *
+ * The data engine reads and writes through IoFile, so the same code runs on
+ * real files (RawFile in xormove.cpp) or on SimDevice, an in-memory device
+ * whose timing is modelled from bandwidth, per-request latency, queue depth
+ * and a seek penalty. SimDevice only logs requests while the engine runs;
+ * simulate() replays the log in virtual time afterwards, so a workload always
+ * produces the same timing however the host scheduled the worker threads.
+ */
+
+#ifndef XORMOVE_IO_BACKEND_H
+#define XORMOVE_IO_BACKEND_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace xmvio {
+
+// One open file as the swap engine sees it
+class IoFile {
+public:
+    enum class Mode { READ, WRITE, READ_WRITE };
+
+    virtual ~IoFile() = default;
+
+    virtual bool isOpen() const = 0;
+    virtual void close() = 0;
+
+    // Sequential read of up to count bytes; bytes read (0 at EOF), -1 on error
+    virtual std::streamsize read(char* buffer, std::streamsize count) = 0;
+    // Sequential write of all count bytes
+    virtual bool write(const char* buffer, std::streamsize count) = 0;
+    // Positional variants; safe to share between threads
+    virtual std::streamsize readAt(char* buffer, std::streamsize count, std::uint64_t offset) = 0;
+    virtual bool writeAt(const char* buffer, std::streamsize count, std::uint64_t offset) = 0;
+
+    virtual bool preallocate(std::uint64_t length) = 0;
+    virtual bool truncate(std::uint64_t length) = 0;
+    virtual bool sync() = 0;
+    // Deallocate [offset, offset + length) so it reads back as zeros, keeping
+    // the size; false where the backend can't, and the caller writes zeros instead
+    virtual bool punchHole(std::uint64_t offset, std::uint64_t length) {
+        (void)offset;
+        (void)length;
+        return false;
+    }
+
+    // Descriptor for page cache hints and extent queries; -1 when there is none
+    virtual int fd() const { return -1; }
+};
+
+// Timing parameters of a simulated device
+struct DeviceModel {
+    double bandwidth = 200e6;   // Bytes per second through the single data channel
+    double latency = 100e-6;    // Seconds from issue until a request can move data
+    unsigned queueDepth = 32;   // Requests the device works on at once
+    double seekPenalty = 0.0;   // Seconds added when a request doesn't start where the last one ended
+};
+
+// What a replayed workload cost on the device
+struct SimResult {
+    double seconds = 0.0;
+    std::uint64_t reads = 0;
+    std::uint64_t writes = 0;
+    std::uint64_t syncs = 0;
+    std::uint64_t seeks = 0;
+    std::uint64_t bytesRead = 0;
+    std::uint64_t bytesWritten = 0;
+};
+
+// In-memory device. Files live back to back in fixed-size regions of one
+// address space, in the order they are created, so requests that alternate
+// between files pay the seek penalty just as they would on one spindle.
+class SimDevice {
+public:
+    SimDevice(const DeviceModel& model, std::uint64_t regionSize) : model_(model), regionSize_(regionSize) {}
+
+    SimDevice(const SimDevice&) = delete;
+    SimDevice& operator=(const SimDevice&) = delete;
+
+    const DeviceModel& model() const { return model_; }
+
+    // Open a file by name; WRITE creates or empties it. Null if READ names no file.
+    std::unique_ptr<IoFile> open(const std::string& name, IoFile::Mode mode) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = files_.find(name);
+        if (found == files_.end()) {
+            if (mode != IoFile::Mode::WRITE) return nullptr;
+            Stored stored;
+            stored.base = nextAddress_;
+            nextAddress_ += regionSize_;
+            found = files_.emplace(name, stored).first;
+        } else if (mode == IoFile::Mode::WRITE) {
+            found->second.data.clear();
+        }
+        return std::unique_ptr<IoFile>(new File(*this, found->second));
+    }
+
+    // Content of a file, for checking results; empty if it doesn't exist
+    std::vector<char> contents(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = files_.find(name);
+        return found == files_.end() ? std::vector<char>() : found->second.data;
+    }
+
+    // Forget the requests logged so far (e.g. while filling the input files)
+    void clearLog() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        streamOf_.clear();
+        streams_.clear();
+    }
+
+    // Replay every logged request in virtual time. Each thread that issued
+    // requests is one stream: a stream issues its next request when the
+    // previous one completes, and streams are served in order of issue time
+    // (ties go to the stream whose first request has the lower address).
+    // Latency overlaps across up to queueDepth requests; seeks and data
+    // transfer share one channel.
+    SimResult simulate() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SimResult result;
+
+        std::vector<const std::vector<Request>*> streams;
+        for (const auto& stream : streams_) {
+            if (!stream.empty()) streams.push_back(&stream);
+        }
+        std::stable_sort(streams.begin(), streams.end(),
+                         [](const std::vector<Request>* a, const std::vector<Request>* b) {
+                             return std::make_tuple(a->front().address, a->front().kind) <
+                                    std::make_tuple(b->front().address, b->front().kind);
+                         });
+
+        std::vector<double> issueAt(streams.size(), 0.0);
+        std::vector<size_t> next(streams.size(), 0);
+        std::vector<double> slotFree(std::max(1u, model_.queueDepth), 0.0);
+        double channelFree = 0.0;
+        std::uint64_t head = 0;
+        bool headKnown = false;
+
+        while (true) {
+            // The pending stream with the earliest issue time goes next
+            size_t pick = streams.size();
+            for (size_t i = 0; i < streams.size(); ++i) {
+                if (next[i] < streams[i]->size() && (pick == streams.size() || issueAt[i] < issueAt[pick])) {
+                    pick = i;
+                }
+            }
+            if (pick == streams.size()) break;
+            const Request& request = (*streams[pick])[next[pick]++];
+
+            auto slot = std::min_element(slotFree.begin(), slotFree.end());
+            double begin = std::max(issueAt[pick], *slot) + model_.latency;
+            begin = std::max(begin, channelFree);
+            if (request.kind != Kind::SYNC) {
+                if (headKnown && request.address != head) {
+                    begin += model_.seekPenalty;
+                    ++result.seeks;
+                }
+                head = request.address + request.length;
+                headKnown = true;
+            }
+            double end = begin + static_cast<double>(request.length) / model_.bandwidth;
+            channelFree = end;
+            *slot = end;
+            issueAt[pick] = end;
+            result.seconds = std::max(result.seconds, end);
+
+            switch (request.kind) {
+            case Kind::READ:
+                ++result.reads;
+                result.bytesRead += request.length;
+                break;
+            case Kind::WRITE:
+                ++result.writes;
+                result.bytesWritten += request.length;
+                break;
+            case Kind::SYNC:
+                ++result.syncs;
+                break;
+            }
+        }
+        return result;
+    }
+
+private:
+    enum class Kind { READ, WRITE, SYNC };
+
+    struct Request {
+        std::uint64_t address;
+        std::uint64_t length;
+        Kind kind;
+    };
+
+    struct Stored {
+        std::uint64_t base = 0;
+        std::vector<char> data;
+    };
+
+    class File : public IoFile {
+    public:
+        File(SimDevice& device, Stored& stored) : device_(device), stored_(stored) {}
+
+        bool isOpen() const override { return open_; }
+        void close() override { open_ = false; }
+
+        std::streamsize read(char* buffer, std::streamsize count) override {
+            std::streamsize n = readAt(buffer, count, position_);
+            if (n > 0) position_ += static_cast<std::uint64_t>(n);
+            return n;
+        }
+
+        bool write(const char* buffer, std::streamsize count) override {
+            if (!writeAt(buffer, count, position_)) return false;
+            position_ += static_cast<std::uint64_t>(count);
+            return true;
+        }
+
+        std::streamsize readAt(char* buffer, std::streamsize count, std::uint64_t offset) override {
+            std::lock_guard<std::mutex> lock(device_.mutex_);
+            std::uint64_t size = stored_.data.size();
+            if (!open_ || count < 0) return -1;
+            std::uint64_t n = offset < size ? std::min<std::uint64_t>(static_cast<std::uint64_t>(count), size - offset) : 0;
+            if (n == 0) return 0;
+            std::memcpy(buffer, stored_.data.data() + offset, static_cast<size_t>(n));
+            device_.log({stored_.base + offset, n, Kind::READ});
+            return static_cast<std::streamsize>(n);
+        }
+
+        bool writeAt(const char* buffer, std::streamsize count, std::uint64_t offset) override {
+            std::lock_guard<std::mutex> lock(device_.mutex_);
+            if (!open_ || count < 0) return false;
+            std::uint64_t end = offset + static_cast<std::uint64_t>(count);
+            if (end > device_.regionSize_) return false;  // Device full
+            if (end > stored_.data.size()) stored_.data.resize(static_cast<size_t>(end));
+            std::memcpy(stored_.data.data() + offset, buffer, static_cast<size_t>(count));
+            device_.log({stored_.base + offset, static_cast<std::uint64_t>(count), Kind::WRITE});
+            return true;
+        }
+
+        bool preallocate(std::uint64_t length) override { return truncate(length); }
+
+        bool truncate(std::uint64_t length) override {
+            std::lock_guard<std::mutex> lock(device_.mutex_);
+            if (!open_ || length > device_.regionSize_) return false;
+            stored_.data.resize(static_cast<size_t>(length));
+            return true;
+        }
+
+        // Metadata only, so no request is logged
+        bool punchHole(std::uint64_t offset, std::uint64_t length) override {
+            std::lock_guard<std::mutex> lock(device_.mutex_);
+            if (!open_) return false;
+            std::uint64_t size = stored_.data.size();
+            if (offset < size) {
+                std::fill(stored_.data.begin() + static_cast<std::ptrdiff_t>(offset),
+                          stored_.data.begin() + static_cast<std::ptrdiff_t>(std::min(size, offset + length)), 0);
+            }
+            return true;
+        }
+
+        bool sync() override {
+            std::lock_guard<std::mutex> lock(device_.mutex_);
+            device_.log({stored_.base, 0, Kind::SYNC});
+            return open_;
+        }
+
+    private:
+        SimDevice& device_;
+        Stored& stored_;
+        std::uint64_t position_ = 0;
+        bool open_ = true;
+    };
+
+    // Called with mutex_ held
+    void log(const Request& request) {
+        auto found = streamOf_.find(std::this_thread::get_id());
+        if (found == streamOf_.end()) {
+            found = streamOf_.emplace(std::this_thread::get_id(), streams_.size()).first;
+            streams_.emplace_back();
+        }
+        streams_[found->second].push_back(request);
+    }
+
+    DeviceModel model_;
+    std::uint64_t regionSize_;
+    std::mutex mutex_;
+    std::map<std::string, Stored> files_;   // Node-based, so File references stay valid
+    std::uint64_t nextAddress_ = 0;
+    std::map<std::thread::id, size_t> streamOf_;
+    std::vector<std::vector<Request>> streams_;
+};
+
+}  // namespace xmvio
+
+#endif  // XORMOVE_IO_BACKEND_H
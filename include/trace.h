@@ -0,0 +1,215 @@
+/**
+ * Timeline tracing for xormove.
+ *
+ * XMV_TRACE_SPAN(name, offset) records a begin/end span for the enclosing
+ * scope. Each thread appends its spans to a ring buffer it owns, so the hot
+ * path takes no lock; once the workers have joined, writeChromeTrace() writes
+ * every ring out as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ * When <sys/sdt.h> is available every span also fires the USDT probes
+ * xmv:span_begin and xmv:span_end (name, offset) for perf and bpftrace.
+ *
+ * Recording is off until start() is called; until then a span costs one
+ * relaxed atomic load. Defining XMV_NO_TRACE (CMake -DXMV_TRACE=OFF)
+ * compiles spans and probes out entirely.
+ */
+
+#ifndef XORMOVE_TRACE_H
+#define XORMOVE_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if !defined(XMV_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define XMV_TRACE_PROBE(probe, name, offset) DTRACE_PROBE2(xmv, probe, name, offset)
+#endif
+#endif
+#ifndef XMV_TRACE_PROBE
+#define XMV_TRACE_PROBE(probe, name, offset) ((void)0)
+#endif
+
+namespace xmvtrace {
+
+// Spans kept per thread; older ones are overwritten once a ring is full
+constexpr std::size_t RING_EVENTS = std::size_t(1) << 16;
+
+struct Event {
+    const char* name;       // String literal
+    std::uint64_t beginNs;  // Since start()
+    std::uint64_t endNs;
+    std::uint64_t offset;   // Byte offset the span worked on
+};
+
+// Written only by its own thread; read after that thread has joined
+class Ring {
+public:
+    explicit Ring(unsigned id) : id_(id), events_(RING_EVENTS) {}
+
+    void push(const Event& event) {
+        std::uint64_t n = count_.load(std::memory_order_relaxed);
+        events_[static_cast<std::size_t>(n % RING_EVENTS)] = event;
+        count_.store(n + 1, std::memory_order_release);
+    }
+
+    unsigned id() const { return id_; }
+    std::uint64_t count() const { return count_.load(std::memory_order_acquire); }
+    std::uint64_t dropped() const { return count() > RING_EVENTS ? count() - RING_EVENTS : 0; }
+
+    // Surviving events, oldest first
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        std::uint64_t end = count();
+        for (std::uint64_t i = dropped(); i < end; ++i) {
+            visit(events_[static_cast<std::size_t>(i % RING_EVENTS)]);
+        }
+    }
+
+private:
+    unsigned id_;
+    std::vector<Event> events_;
+    std::atomic<std::uint64_t> count_{0};
+};
+
+inline std::atomic<bool> enabled{false};
+inline std::chrono::steady_clock::time_point origin;
+inline thread_local Ring* threadRing = nullptr;
+
+// All rings ever created; the mutex is only taken when a thread records its first span
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+};
+
+inline Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+inline std::uint64_t now() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+}
+
+inline Ring& ring() {
+    if (!threadRing) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.rings.push_back(std::make_unique<Ring>(static_cast<unsigned>(reg.rings.size() + 1)));
+        threadRing = reg.rings.back().get();
+    }
+    return *threadRing;
+}
+
+inline void start() {
+    origin = std::chrono::steady_clock::now();
+    enabled.store(true, std::memory_order_release);
+}
+
+class Span {
+public:
+    Span(const char* name, std::uint64_t offset) : name_(name), offset_(offset) {
+        XMV_TRACE_PROBE(span_begin, name, offset);
+        if (enabled.load(std::memory_order_relaxed)) {
+            active_ = true;
+            beginNs_ = now();
+        }
+    }
+
+    ~Span() {
+        XMV_TRACE_PROBE(span_end, name_, offset_);
+        if (active_) {
+            ring().push({name_, beginNs_, now(), offset_});
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name_;
+    std::uint64_t offset_;
+    bool active_ = false;
+    std::uint64_t beginNs_ = 0;
+};
+
+// Write every recorded span as complete ("X") events; call after workers have joined
+inline bool writeChromeTrace(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) return false;
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    std::uint64_t dropped = 0;
+    bool first = true;
+    auto separator = [&]() -> std::ostream& {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        return out;
+    };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\": [";
+    for (const auto& ring : reg.rings) {
+        separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->id()
+                    << ", \"args\": {\"name\": \"xmv thread " << ring->id() << "\"}}";
+        ring->forEach([&](const Event& event) {
+            separator() << "{\"name\": \"" << event.name << "\", \"cat\": \"xmv\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                        << ring->id() << ", \"ts\": " << event.beginNs / 1000.0
+                        << ", \"dur\": " << (event.endNs - event.beginNs) / 1000.0
+                        << ", \"args\": {\"offset\": " << event.offset << "}}";
+        });
+        dropped += ring->dropped();
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+    return out.good();
+}
+
+// Records from construction and writes the trace on destruction (no-op for an
+// empty path). The file is created up front so a bad path fails before any work.
+class Session {
+public:
+    explicit Session(const std::string& path) : path_(path) {
+        if (path_.empty()) return;
+        ok_ = std::ofstream(path_, std::ios::trunc).good();
+        if (ok_) start();
+    }
+
+    bool ok() const { return path_.empty() || ok_; }
+
+    ~Session() {
+        if (path_.empty() || !ok_) return;
+        enabled.store(false, std::memory_order_release);
+        if (!writeChromeTrace(path_)) {
+            std::cerr << "Error: Unable to write trace file: " << path_ << std::endl;
+        }
+    }
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+private:
+    std::string path_;
+    bool ok_ = false;
+};
+
+}  // namespace xmvtrace
+
+#ifdef XMV_NO_TRACE
+#define XMV_TRACE_SPAN(name, offset) ((void)0)
+#else
+#define XMV_TRACE_CONCAT_(a, b) a##b
+#define XMV_TRACE_CONCAT(a, b) XMV_TRACE_CONCAT_(a, b)
+#define XMV_TRACE_SPAN(name, offset) \
+    ::xmvtrace::Span XMV_TRACE_CONCAT(xmvTraceSpan, __LINE__)((name), static_cast<std::uint64_t>(offset))
+#endif
+
+#endif  // XORMOVE_TRACE_H
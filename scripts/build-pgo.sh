@@ -0,0 +1,101 @@
+#!/bin/bash
+# xormove profile-guided release build (Linux/macOS)
+#
+# 1. Configure and build the <os>-pgo-generate preset (instrumented, LTO)
+# 2. Train it with the throughput test workload (ctest -L perf)
+# 3. Merge the profile (Clang only) and rebuild with the <os>-pgo-use preset
+#
+# Both stages share build/<os>-pgo, so GCC finds its .gcda files again.
+
+set -e
+
+# Navigate to project root
+cd "$(dirname "$0")/.."
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+echo_info() { echo -e "${GREEN}[INFO]${NC} $1"; }
+echo_error() { echo -e "${RED}[ERROR]${NC} $1"; }
+
+show_help() {
+    echo "xormove PGO Build Script"
+    echo ""
+    echo "Usage: $0 [options]"
+    echo ""
+    echo "Options:"
+    echo "  --help, -h      Show this help message"
+    echo "  --size SIZE     File size for the training swaps (default 256M)"
+    echo "  --clean         Remove build/<os>-pgo before building"
+    echo ""
+    echo "The training run honours the throughput test variables, e.g."
+    echo "XMV_TEST_DIR and XMV_TEST_CROSS_DIR (see docs/BUILDING.md)."
+    echo ""
+}
+
+case "$(uname -s)" in
+    Darwin*) OS_NAME="macos";;
+    *)       OS_NAME="linux";;
+esac
+
+TRAIN_SIZE="256M"
+CLEAN_BUILD=0
+
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        --help|-h)
+            show_help
+            exit 0
+            ;;
+        --size)
+            TRAIN_SIZE="$2"
+            shift 2
+            ;;
+        --clean)
+            CLEAN_BUILD=1
+            shift
+            ;;
+        *)
+            echo_error "Unknown option: $1"
+            show_help
+            exit 1
+            ;;
+    esac
+done
+
+BUILD_DIR="build/${OS_NAME}-pgo"
+PROFILE_DIR="${BUILD_DIR}/profile"
+
+if [ $CLEAN_BUILD -eq 1 ]; then
+    echo_info "Cleaning ${BUILD_DIR}..."
+    rm -rf "${BUILD_DIR}"
+fi
+
+echo_info "Stage 1: instrumented build (${OS_NAME}-pgo-generate)"
+rm -rf "${PROFILE_DIR}"
+cmake --preset "${OS_NAME}-pgo-generate"
+cmake --build --preset "${OS_NAME}-pgo-generate"
+
+echo_info "Stage 2: training with the throughput workload (${TRAIN_SIZE} files)"
+# Instrumented timings are meaningless, so keep them out of the real baseline
+XMV_TEST_SIZE="${TRAIN_SIZE}" XMV_TEST_LARGE_SIZE=0 XMV_PERF_BASELINE="${PROFILE_DIR}/training_baseline.txt" \
+    ctest --test-dir "${BUILD_DIR}" -L perf --output-on-failure
+
+if ls "${PROFILE_DIR}"/*.profraw &> /dev/null; then
+    # Clang writes raw profiles that must be merged first
+    PROFDATA=$(command -v llvm-profdata || xcrun --find llvm-profdata 2> /dev/null || true)
+    if [ -z "$PROFDATA" ]; then
+        echo_error "llvm-profdata not found; it is needed to merge Clang profiles."
+        exit 1
+    fi
+    "$PROFDATA" merge -output="${PROFILE_DIR}/xmv.profdata" "${PROFILE_DIR}"/*.profraw
+fi
+
+echo_info "Stage 3: optimized build (${OS_NAME}-pgo-use)"
+cmake --preset "${OS_NAME}-pgo-use"
+cmake --build --preset "${OS_NAME}-pgo-use" --clean-first
+
+echo_info "Build successful!"
+echo_info "Executable: ${BUILD_DIR}/xmv"
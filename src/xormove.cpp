@@ -10,22 +10,116 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <set>
+#include <map>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/xattr.h>
+#endif
+
+#if defined(__APPLE__)
+#include <sys/ioctl.h>
+#include <sys/disk.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #include "version.h"
+#include "xor_kernels.h"
+#include "trace.h"
+#include "io_backend.h"
+#include "checksums.h"
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/hex.hpp>
 #include <boost/algorithm/string.hpp>
 
+// Daemon jobs (--daemon) each send their output to their own client, so
+// std::cout and std::cerr are routed per thread: a thread running a job
+// writes to that job's stream, every other thread to the console.
+thread_local std::streambuf* jobStdout = nullptr;
+thread_local std::streambuf* jobStderr = nullptr;
+
+class RoutedStreamBuf : public std::streambuf {
+public:
+    RoutedStreamBuf(std::streambuf* console, std::streambuf* (*route)()) : console_(console), route_(route) {}
+
+    // Where the calling thread's output goes
+    std::streambuf* target() const {
+        std::streambuf* job = route_();
+        return job ? job : console_;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        return target()->sputc(traits_type::to_char_type(c));
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override { return target()->sputn(s, n); }
+    int sync() override { return target()->pubsync(); }
+
+private:
+    std::streambuf* console_;
+    std::streambuf* (*route_)();
+};
+
+// The buffer os reaches from this thread; for writers that other threads use later
+std::streambuf* threadTarget(std::ostream& os) {
+    RoutedStreamBuf* routed = dynamic_cast<RoutedStreamBuf*>(os.rdbuf());
+    return routed ? routed->target() : os.rdbuf();
+}
+
 // Simple progress bar replacement for deprecated boost::timer::progress_display
+// Counts are 64-bit so multi-GB files don't overflow where unsigned long is 32 bits (Windows)
+// Range workers tick it from their own threads, so it binds to its creator's output.
 class ProgressBar {
 public:
-    explicit ProgressBar(unsigned long total, std::ostream& os = std::cout)
-        : total_(total), current_(0), os_(os), width_(50) {
+    explicit ProgressBar(std::uint64_t total, std::ostream& os = std::cout)
+        : total_(total), current_(0), os_(threadTarget(os)), width_(50) {
         display();
     }
 
@@ -38,11 +132,11 @@ public:
 private:
     void display() {
         if (total_ == 0) return;
-        unsigned long percent = (current_ * 100) / total_;
-        unsigned long filled = (current_ * width_) / total_;
+        std::uint64_t percent = (current_ * 100) / total_;
+        std::uint64_t filled = (current_ * width_) / total_;
 
         os_ << "\r[";
-        for (unsigned long i = 0; i < width_; ++i) {
+        for (std::uint64_t i = 0; i < width_; ++i) {
             os_ << (i < filled ? '=' : (i == filled ? '>' : ' '));
         }
         os_ << "] " << percent << "% (" << current_ << "/" << total_ << ")";
@@ -51,371 +145,4946 @@ private:
         if (current_ >= total_) os_ << std::endl;
     }
 
-    unsigned long total_;
-    unsigned long current_;
-    std::ostream& os_;
-    unsigned long width_;
+    std::uint64_t total_;
+    std::uint64_t current_;
+    std::ostream os_;
+    std::uint64_t width_;
 };
 
 #include <argparse/argparse.hpp>
 //#include <cryptopp/sha.h>
 #include <cryptopp/default.h>
+#include <xxhash.h>
+#ifdef XMV_XXH3_DISPATCH
+// Set by CMake when xxHash was built with its x86 dispatcher: XXH3 then picks
+// SSE2, AVX2 or AVX-512 at run time instead of the ISA the library was built for
+#include <xxh_x86dispatch.h>
+#endif
 
 namespace fs = boost::filesystem;
+using xmvio::IoFile;
 
 const std::streamsize CHUNK_SIZE_SECURE = 1024 * 1024;
 const std::streamsize CHUNK_SIZE_FAST = 4096;
+const std::uint64_t DEFAULT_WRITEBACK_INTERVAL = 64ULL * 1024 * 1024;
+const std::uint64_t DEFAULT_MAX_MEMORY = 64ULL * 1024 * 1024;
+const std::uint64_t MIN_MAX_MEMORY = 64ULL * 1024;
+const size_t HASH_BUFFER_SIZE = 1024 * 1024;
+const size_t BUFFER_ALIGNMENT = 4096;
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+const std::uint64_t SMALL_FILE_LIMIT = 64 * 1024;
+const unsigned MAX_SWAP_THREADS = 64;
+const std::uint64_t DIGEST_CHUNK_SIZE = 1024 * 1024;
+const size_t CHUNK_DIGEST_BYTES = 16;      // Truncated SHA-256 per chunk
+const char* const CHECKSUM_XATTR_NAME = "user.xmv.sums";
+const char* const CHECKSUM_SIDECAR_SUFFIX = ".xmvsum";
+const int CHECKSUM_FORMAT = 1;
+const std::uint64_t MOVE_CHUNK_SIZE = 16ULL * 1024 * 1024;
+const char* const PARTIAL_MOVE_SUFFIX = ".xmv_partial";
+const char* const MOVE_ORIGIN_SUFFIX = ".xmv_origin";     // Next to the partial file: what it was moved from
+const std::uint64_t DEFAULT_SLACK = 16ULL * 1024 * 1024;
+const std::uint64_t MIN_SLACK = 64ULL * 1024;
+const std::uint64_t JOURNAL_HEADER_SIZE = 4096;
+const std::uint64_t JOURNAL_RECORD_META = 64;
+const char* const JOURNAL_SUFFIX = ".xmv_journal";
+const std::uint64_t LARGE_EXTENT_SIZE = 32ULL * 1024 * 1024;
+const unsigned FIEMAP_BATCH = 256;                       // Extents fetched per FIEMAP call
+const std::uint64_t SEEK_BOUND_RUN = 4ULL * 1024 * 1024;  // Average contiguous run below which a swap seeks more than it streams
+const std::uint64_t SPARSE_BLOCK_SIZE = 4096;            // --sparse hole granularity, aligned to file offsets
+const size_t SYNCFS_MIN_DIRECTORIES = 16;                // --sync=end flushes a filesystem with this many changed directories with one syncfs()
 
-// Path destination strategy types
-enum class PathStrategy {
-    SAME,       // Keep original path (default, swap in place)
-    REL,        // Preserve relative path on target drive
-    SAME_AS_1,  // Use file 1's path structure
-    SAME_AS_2,  // Use file 2's path structure
-    EXPLICIT    // User-specified path
+// Page cache handling for the swap streams
+enum class CacheMode {
+    NORMAL,     // Leave caching to the OS (default)
+    STREAM      // Sequential hints, periodic writeback, drop processed pages
 };
 
-// Struct to hold parsed destination info
-struct DestinationSpec {
-    PathStrategy strategy;
-    std::string explicitPath;  // Only used if strategy == EXPLICIT
+struct CachePolicy {
+    CacheMode mode = CacheMode::NORMAL;
+    std::uint64_t writebackInterval = DEFAULT_WRITEBACK_INTERVAL;  // Bytes between writeback kicks
+
+    bool streaming() const { return mode == CacheMode::STREAM; }
 };
 
-// Set of actions that --yes can auto-confirm
-struct YesActions {
-    bool mkdir = false;
-    bool overwrite = false;
-    bool all = false;
+// --large-extents: how the sequential swap loop sizes its I/O
+enum class ExtentMode {
+    AUTO,       // Large extents when both files share a rotational disk (default)
+    ON,         // Always stage large extents through the memory budget
+    OFF         // Chunk-sized I/O (--secure/--fast sizes)
+};
 
-    bool shouldAutoMkdir() const { return mkdir || all; }
-    bool shouldAutoOverwrite() const { return overwrite || all; }
+// --verify=ALGO: whole-file checksum used to check the temp copies
+enum class VerifyAlgorithm {
+    SHA256,     // CryptoPP SHA-256 (default)
+    CRC32C,     // CRC-32C, hardware instructions when the CPU has them
+    XXH3        // 64-bit XXH3
 };
 
-// Convert string to uppercase for case-insensitive comparison
-std::string toUpperCase(const std::string& str) {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
-    return result;
-}
+// Where per-chunk digest tables are kept between runs
+enum class ChecksumStore {
+    OFF,        // No checksum cache (default)
+    XATTR,      // user.xmv.sums extended attribute, sidecar when it doesn't fit
+    SIDECAR     // "<file>.xmvsum" next to the file
+};
 
-// Parse --yes arguments into YesActions
-YesActions parseYesActions(const std::vector<std::string>& args) {
-    YesActions actions;
+// --sync: when new data and renames are forced to disk
+enum class SyncPolicy {
+    NONE,       // Leave it to the OS
+    END,        // Sync data before each rename, directories once per run (default)
+    PARANOID    // Also sync the directories of every rename right away
+};
 
-    if (args.empty()) {
-        // Bare --yes means safe actions only (mkdir)
-        actions.mkdir = true;
-        return actions;
+class SyncBatch;
+
+// A byte range of one file (--range-a, --range-b)
+struct FileRegion {
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+};
+
+// Options that control a single xorSwap() run
+struct SwapOptions {
+    bool secure = false;
+    bool fast = false;
+    bool verify = false;
+    VerifyAlgorithm verifyAlgorithm = VerifyAlgorithm::SHA256;
+    bool verbose = false;
+    bool progress = false;
+    std::string logFile;
+    CachePolicy cache;
+    unsigned threads = 1;   // Workers for intra-file range swapping (--threads)
+    ChecksumStore checksums = ChecksumStore::OFF;
+    bool inPlace = false;                   // Journaled in-place swap instead of temp copies
+    std::uint64_t slack = DEFAULT_SLACK;    // Extra space an in-place swap may use per device (--slack)
+    ExtentMode extents = ExtentMode::AUTO;
+    bool physicalOrder = false;             // Range workers visit chunks in on-disk order (--physical-order)
+    bool sparse = false;                    // Leave all-zero output blocks as holes (--sparse)
+    FileRegion regionA;                     // Swap only these ranges in place; length 0 swaps whole files
+    FileRegion regionB;
+    SyncPolicy sync = SyncPolicy::END;
+    SyncBatch* syncBatch = nullptr;         // Directories renamed into during this run (--sync)
+    fs::path journalDir;                    // Where journals for block devices go (--journal-dir); required for them
+};
+
+// Thin RAII wrapper around a raw file descriptor; the real-file backend of the swap engine.
+// The swap loop needs the descriptor itself for cache hints, which iostreams don't expose.
+class RawFile : public IoFile {
+public:
+    RawFile() = default;
+    RawFile(const std::string& path, Mode mode) { open(path, mode); }
+    ~RawFile() override { close(); }
+
+    RawFile(const RawFile&) = delete;
+    RawFile& operator=(const RawFile&) = delete;
+
+    bool open(const std::string& path, Mode mode) {
+        close();
+#ifdef _WIN32
+        int flags = _O_BINARY | (mode == Mode::READ ? _O_RDONLY :
+                                 mode == Mode::READ_WRITE ? _O_RDWR : (_O_WRONLY | _O_CREAT | _O_TRUNC));
+        fd_ = _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+        int flags = (mode == Mode::READ ? O_RDONLY :
+                     mode == Mode::READ_WRITE ? O_RDWR : (O_WRONLY | O_CREAT | O_TRUNC));
+        fd_ = ::open(path.c_str(), flags, 0666);
+#endif
+        return fd_ >= 0;
     }
 
-    for (const auto& arg : args) {
-        std::string upper = toUpperCase(arg);
-        if (upper == "MKDIR") {
-            actions.mkdir = true;
-        } else if (upper == "OVERWRITE" || upper == "FORCE") {
-            actions.overwrite = true;
-        } else if (upper == "ALL") {
-            actions.all = true;
-        }
+    void close() override {
+        if (fd_ < 0) return;
+#ifdef _WIN32
+        _close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
     }
 
-    return actions;
-}
+    // Read up to count bytes, retrying short reads. Returns bytes read (0 at EOF), -1 on error.
+    std::streamsize read(char* buffer, std::streamsize count) override {
+        std::streamsize total = 0;
+        while (total < count) {
+#ifdef _WIN32
+            int n = _read(fd_, buffer + total, static_cast<unsigned int>(count - total));
+#else
+            ssize_t n = ::read(fd_, buffer + total, static_cast<size_t>(count - total));
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n < 0) return -1;
+            if (n == 0) break;
+            total += n;
+        }
+        return total;
+    }
 
-// Parse destination specifier (--1-to or --2-to value)
-DestinationSpec parseDestination(const std::string& spec, int fileNum) {
-    DestinationSpec dest;
-    std::string upper = toUpperCase(spec);
+    // Write all count bytes. Returns false on error.
+    bool write(const char* buffer, std::streamsize count) override {
+        std::streamsize total = 0;
+        while (total < count) {
+#ifdef _WIN32
+            int n = _write(fd_, buffer + total, static_cast<unsigned int>(count - total));
+#else
+            ssize_t n = ::write(fd_, buffer + total, static_cast<size_t>(count - total));
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n <= 0) return false;
+            total += n;
+        }
+        return true;
+    }
 
-    if (upper == "SAME") {
-        dest.strategy = PathStrategy::SAME;
-    } else if (upper == "REL") {
-        dest.strategy = PathStrategy::REL;
-    } else if (upper == "SAME-AS-1") {
-        dest.strategy = PathStrategy::SAME_AS_1;
-    } else if (upper == "SAME-AS-2") {
-        dest.strategy = PathStrategy::SAME_AS_2;
-    } else {
-        // Treat as explicit path
-        dest.strategy = PathStrategy::EXPLICIT;
-        dest.explicitPath = spec;
+    // Positional read of up to count bytes at offset; safe to share between threads.
+    // Returns bytes read (short only at EOF), -1 on error.
+    std::streamsize readAt(char* buffer, std::streamsize count, std::uint64_t offset) override {
+        std::streamsize total = 0;
+        while (total < count) {
+#ifdef _WIN32
+            // No pread on Windows; callers there use a single worker
+            if (!seek(offset + static_cast<std::uint64_t>(total))) return -1;
+            int n = _read(fd_, buffer + total, static_cast<unsigned int>(count - total));
+#else
+            ssize_t n = ::pread(fd_, buffer + total, static_cast<size_t>(count - total),
+                                static_cast<off_t>(offset + static_cast<std::uint64_t>(total)));
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n < 0) return -1;
+            if (n == 0) break;
+            total += n;
+        }
+        return total;
     }
 
-    // SAME-AS-SELF is equivalent to REL
-    if ((fileNum == 1 && dest.strategy == PathStrategy::SAME_AS_1) ||
-        (fileNum == 2 && dest.strategy == PathStrategy::SAME_AS_2)) {
-        dest.strategy = PathStrategy::REL;
+    // Positional write of all count bytes at offset; safe to share between threads
+    bool writeAt(const char* buffer, std::streamsize count, std::uint64_t offset) override {
+        std::streamsize total = 0;
+        while (total < count) {
+#ifdef _WIN32
+            if (!seek(offset + static_cast<std::uint64_t>(total))) return false;
+            int n = _write(fd_, buffer + total, static_cast<unsigned int>(count - total));
+#else
+            ssize_t n = ::pwrite(fd_, buffer + total, static_cast<size_t>(count - total),
+                                 static_cast<off_t>(offset + static_cast<std::uint64_t>(total)));
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n <= 0) return false;
+            total += n;
+        }
+        return true;
     }
 
-    return dest;
-}
+    // Reserve length bytes up front (where the filesystem supports it) and set the size
+    bool preallocate(std::uint64_t length) override {
+#if defined(__linux__)
+        if (length > 0 && fallocate(fd_, 0, 0, static_cast<off_t>(length)) == 0) return true;
+#endif
+        return truncate(length);
+    }
 
-// Get the relative path portion (without drive letter/root)
-fs::path getRelativePath(const fs::path& fullPath) {
-    // For Windows: C:\folder\file.bin -> folder\file.bin
-    // For Unix: /home/user/file.bin -> home/user/file.bin
-    fs::path rel = fullPath;
-    if (rel.has_root_name()) {
-        rel = fs::path(rel.string().substr(rel.root_name().string().length()));
+    // Deallocate a range in place (Linux); other platforms write zeros instead
+    bool punchHole(std::uint64_t offset, std::uint64_t length) override {
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+        return fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                         static_cast<off_t>(length)) == 0;
+#else
+        (void)offset;
+        (void)length;
+        return false;
+#endif
     }
-    if (rel.has_root_directory()) {
-        rel = rel.relative_path();
+
+    // Move the file offset to an absolute position
+    bool seek(std::uint64_t offset) {
+#ifdef _WIN32
+        return _lseeki64(fd_, static_cast<__int64>(offset), SEEK_SET) >= 0;
+#else
+        return ::lseek(fd_, static_cast<off_t>(offset), SEEK_SET) >= 0;
+#endif
     }
-    return rel;
-}
 
-// Get the drive/root portion of a path
-fs::path getDriveRoot(const fs::path& fullPath) {
-    // For Windows: C:\folder\file.bin -> C:\
-    // For Unix: /home/user/file.bin -> /
-    fs::path root;
-    if (fullPath.has_root_name()) {
-        root = fullPath.root_name();
+    // Set the file length
+    bool truncate(std::uint64_t length) override {
+#ifdef _WIN32
+        return _chsize_s(fd_, static_cast<__int64>(length)) == 0;
+#else
+        return ::ftruncate(fd_, static_cast<off_t>(length)) == 0;
+#endif
     }
-    if (fullPath.has_root_directory()) {
-        root /= fullPath.root_directory();
+
+    // Flush written data to stable storage
+    bool sync() override {
+#ifdef _WIN32
+        return _commit(fd_) == 0;
+#elif defined(__linux__)
+        return ::fdatasync(fd_) == 0;
+#else
+        return ::fsync(fd_) == 0;
+#endif
     }
-    return root;
-}
 
-// Resolve final destination path based on strategy
-fs::path resolveDestination(const fs::path& sourceFile,
-                            const fs::path& otherFile,
-                            const DestinationSpec& destSpec,
-                            int /*fileNum*/) {
-    fs::path targetDrive = getDriveRoot(otherFile);
+    bool isOpen() const override { return fd_ >= 0; }
+    int fd() const override { return fd_; }
 
-    switch (destSpec.strategy) {
-        case PathStrategy::SAME:
-            // Keep original path
-            return sourceFile;
+private:
+    int fd_ = -1;
+};
 
-        case PathStrategy::REL: {
-            // Preserve relative path on target drive
-            fs::path relPath = getRelativePath(sourceFile);
-            return targetDrive / relPath;
-        }
+// Metadata for one path, gathered with a single stat call and reused
+struct FileStat {
+    bool exists = false;
+    bool isDirectory = false;
+    std::uint64_t size = 0;
+    std::uint64_t device = 0;
+    std::int64_t mtimeNs = 0;   // Modification time, nanoseconds since the epoch
+    std::uint64_t inode = 0;    // 0 where the platform doesn't report one
+    bool isBlockDevice = false; // size is then the device capacity
+    std::uint32_t logicalBlock = 0;   // Block devices: smallest addressable unit in bytes
+};
 
-        case PathStrategy::SAME_AS_1: {
-            // Use file 1's folder structure (caller ensures this isn't self-referential)
-            fs::path otherRel = getRelativePath(otherFile);
-            fs::path otherDir = otherRel.parent_path();
-            return targetDrive / otherDir / sourceFile.filename();
-        }
+// Capacity and logical block size of a block device (stat reports size 0 for them)
+void readBlockGeometry(const fs::path& path, FileStat& info) {
+    info.isBlockDevice = true;
+#if defined(__linux__) || defined(__APPLE__)
+    int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) return;
+#if defined(__linux__)
+    std::uint64_t bytes = 0;
+    int sector = 0;
+    if (ioctl(fd, BLKGETSIZE64, &bytes) == 0) info.size = bytes;
+    if (ioctl(fd, BLKSSZGET, &sector) == 0 && sector > 0) info.logicalBlock = static_cast<std::uint32_t>(sector);
+#else
+    std::uint64_t count = 0;
+    std::uint32_t sector = 0;
+    if (ioctl(fd, DKIOCGETBLOCKSIZE, &sector) == 0 && ioctl(fd, DKIOCGETBLOCKCOUNT, &count) == 0) {
+        info.size = count * sector;
+        info.logicalBlock = sector;
+    }
+#endif
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
 
-        case PathStrategy::SAME_AS_2: {
-            // Use file 2's folder structure
-            fs::path otherRel = getRelativePath(otherFile);
-            fs::path otherDir = otherRel.parent_path();
-            return targetDrive / otherDir / sourceFile.filename();
-        }
+// False if a block device is mounted or claimed (Linux O_EXCL semantics);
+// elsewhere the caller is trusted
+bool blockDeviceUnused(const fs::path& path) {
+#if defined(__linux__)
+    int fd = ::open(path.string().c_str(), O_RDONLY | O_EXCL);
+    if (fd < 0) return errno != EBUSY;
+    ::close(fd);
+#else
+    (void)path;
+#endif
+    return true;
+}
 
-        case PathStrategy::EXPLICIT: {
-            // User-specified path
-            std::string pathStr = destSpec.explicitPath;
+// Name of a block device that survives reboots and re-enumeration: its
+// /dev/disk/by-id link (the first in sorted order, so every run picks the
+// same one) or, for a loop device, its backing file. Elsewhere, and for
+// devices without either, the canonical device path.
+std::string blockDeviceIdentity(const fs::path& path) {
+    boost::system::error_code ec;
+    fs::path device = fs::canonical(path, ec);
+    if (ec) device = fs::absolute(path);
+#if defined(__linux__)
+    std::vector<std::string> links;
+    for (fs::directory_iterator it(fs::path("/dev/disk/by-id"), ec), end; !ec && it != end; it.increment(ec)) {
+        boost::system::error_code linkError;
+        fs::path target = fs::canonical(it->path(), linkError);
+        if (!linkError && target == device) links.push_back(it->path().filename().string());
+    }
+    if (!links.empty()) return "by-id/" + *std::min_element(links.begin(), links.end());
 
-            // Handle root specifier "/" or "\" - means root of target drive
-            if (pathStr == "/" || pathStr == "\\") {
-                return targetDrive / sourceFile.filename();
-            }
+    std::ifstream backing("/sys/class/block/" + device.filename().string() + "/loop/backing_file");
+    std::string file;
+    if (std::getline(backing, file) && !file.empty()) return "loop" + file;
+#endif
+    return device.string();
+}
 
+FileStat statPath(const fs::path& path) {
+    FileStat info;
 #ifdef _WIN32
-            // Normalize forward slashes to backslashes on Windows
-            std::replace(pathStr.begin(), pathStr.end(), '/', '\\');
+    struct _stat64 st;
+    if (_wstat64(path.wstring().c_str(), &st) == 0) {
+        info.exists = true;
+        info.isDirectory = (st.st_mode & _S_IFDIR) != 0;
+        info.size = static_cast<std::uint64_t>(st.st_size);
+        info.device = static_cast<std::uint64_t>(st.st_dev);
+        info.mtimeNs = static_cast<std::int64_t>(st.st_mtime) * 1000000000LL;
+    }
+#elif defined(__linux__) && defined(STATX_BASIC_STATS)
+    // statx fetches only the fields we ask for
+    struct statx stx;
+    if (statx(AT_FDCWD, path.string().c_str(), 0, STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) == 0) {
+        info.exists = true;
+        info.isDirectory = S_ISDIR(stx.stx_mode);
+        info.size = stx.stx_size;
+        info.device = static_cast<std::uint64_t>(makedev(stx.stx_dev_major, stx.stx_dev_minor));
+        info.mtimeNs = static_cast<std::int64_t>(stx.stx_mtime.tv_sec) * 1000000000LL + stx.stx_mtime.tv_nsec;
+        info.inode = stx.stx_ino;
+        if (S_ISBLK(stx.stx_mode)) readBlockGeometry(path, info);
+    }
+#else
+    struct stat st;
+    if (stat(path.string().c_str(), &st) == 0) {
+        info.exists = true;
+        info.isDirectory = S_ISDIR(st.st_mode);
+        info.size = static_cast<std::uint64_t>(st.st_size);
+        info.device = static_cast<std::uint64_t>(st.st_dev);
+        info.inode = static_cast<std::uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+        info.mtimeNs = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+        info.mtimeNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+        if (S_ISBLK(st.st_mode)) readBlockGeometry(path, info);
+    }
 #endif
+    return info;
+}
 
-            fs::path explicitPath(pathStr);
+// Flush a directory's entries to disk, so renames and creations in it survive
+// a crash. Windows has no portable equivalent; NTFS journals its metadata.
+bool syncDirectory(const fs::path& dir) {
+#ifdef _WIN32
+    (void)dir;
+    return true;
+#else
+    XMV_TRACE_SPAN("fsync dir", 0);
+    int fd = ::open(dir.empty() ? "." : dir.string().c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
 
-            // Check if it's a path starting with / or \ (relative to drive root)
-            if (!pathStr.empty() && (pathStr[0] == '\\' || pathStr[0] == '/')) {
-                // Path like "/staging" means targetDrive + staging
-                return targetDrive / explicitPath.relative_path() / sourceFile.filename();
-            }
+// Group commit for --sync: directories changed by renames are flushed once
+// at the end of a run instead of after every file. When a run touched many
+// directories on one filesystem, a single syncfs() (Linux) replaces their
+// fsyncs. --sync=paranoid flushes each rename's directories immediately.
+class SyncBatch {
+public:
+    explicit SyncBatch(SyncPolicy policy) : policy_(policy) {}
+    ~SyncBatch() { flush(); }   // Still flushes when an exception ends the run
 
-            if (explicitPath.is_absolute() && explicitPath.has_root_name()) {
-                // Fully absolute path with drive letter (e.g., D:\temp)
-                // Use as-is but append filename if it's a directory
-                if (explicitPath.extension().empty() && !explicitPath.filename_is_dot()) {
-                    return explicitPath / sourceFile.filename();
-                }
-                return explicitPath;
-            } else {
-                // Relative path - relative to target drive
-                return targetDrive / explicitPath / sourceFile.filename();
+    SyncBatch(const SyncBatch&) = delete;
+    SyncBatch& operator=(const SyncBatch&) = delete;
+
+    SyncPolicy policy() const { return policy_; }
+
+    // A path was renamed; false if --sync=paranoid couldn't flush it
+    bool renamed(const fs::path& from, const fs::path& to) {
+        std::set<fs::path> dirs = {from.parent_path(), to.parent_path()};
+        if (policy_ == SyncPolicy::PARANOID) {
+            bool ok = true;
+            for (const auto& dir : dirs) ok = syncDirectory(dir) && ok;
+            return ok;
+        }
+        if (policy_ == SyncPolicy::END) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.insert(dirs.begin(), dirs.end());
+        }
+        return true;
+    }
+
+    // Flush every pending directory; false if any flush failed
+    bool flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::uint64_t, std::vector<fs::path>> byDevice;
+        for (const auto& dir : pending_) {
+            byDevice[statPath(dir).device].push_back(dir);
+        }
+        pending_.clear();
+
+        bool ok = true;
+        for (const auto& device : byDevice) {
+#if defined(__linux__)
+            if (device.second.size() >= SYNCFS_MIN_DIRECTORIES) {
+                XMV_TRACE_SPAN("syncfs", device.second.size());
+                int fd = ::open(device.second.front().string().c_str(), O_RDONLY | O_DIRECTORY);
+                ok = fd >= 0 && ::syncfs(fd) == 0 && ok;
+                if (fd >= 0) ::close(fd);
+                continue;
+            }
+#endif
+            for (const auto& dir : device.second) {
+                ok = syncDirectory(dir) && ok;
             }
         }
+        return ok;
     }
 
-    // Default fallback
-    return sourceFile;
+private:
+    SyncPolicy policy_;
+    std::mutex mutex_;
+    std::set<fs::path> pending_;
+};
+
+// Record a rename with the run's sync batch, if there is one
+bool noteRename(const SwapOptions& options, const fs::path& from, const fs::path& to) {
+    return !options.syncBatch || options.syncBatch->renamed(from, to);
 }
 
-// Prompt user for yes/no confirmation
-bool promptYesNo(const std::string& message, bool defaultYes = false) {
-    std::string prompt = message + (defaultYes ? " [Y/n]: " : " [y/N]: ");
-    std::cout << prompt;
-    std::cout.flush();
+// The disk behind a filesystem, from sysfs (Linux only; unknown elsewhere)
+struct BlockDeviceInfo {
+    bool known = false;
+    bool rotational = false;
+    std::string disk;       // sysfs path of the whole disk, for "same spindle" checks
+};
 
-    std::string response;
-    std::getline(std::cin, response);
-    boost::algorithm::trim(response);
+BlockDeviceInfo blockDeviceInfo(std::uint64_t device) {
+    BlockDeviceInfo info;
+#if defined(__linux__)
+    boost::system::error_code ec;
+    fs::path node = fs::canonical("/sys/dev/block/" + std::to_string(major(device)) + ":" +
+                                  std::to_string(minor(device)), ec);
+    if (ec) return info;
 
-    if (response.empty()) {
-        return defaultYes;
+    // Partitions have no queue/ of their own; their parent directory is the disk
+    if (fs::exists(node / "partition")) {
+        node = node.parent_path();
     }
+    std::ifstream in((node / "queue" / "rotational").string());
+    int flag = 0;
+    if (in >> flag) {
+        info.known = true;
+        info.rotational = (flag == 1);
+        info.disk = node.string();
+    }
+#else
+    (void)device;
+#endif
+    return info;
+}
 
-    char first = static_cast<char>(std::tolower(static_cast<unsigned char>(response[0])));
-    return (first == 'y');
+// True if the swap loop should stage large extents: on request, or when both
+// files live on the same spinning disk, where alternating small reads and
+// writes between four files costs a seek each. Range workers asked for with
+// --threads take precedence over the automatic choice.
+bool useLargeExtents(const FileStat& statA, const FileStat& statB, ExtentMode mode, unsigned threads) {
+    if (mode != ExtentMode::AUTO) return mode == ExtentMode::ON;
+    if (threads > 1) return false;
+    BlockDeviceInfo diskA = blockDeviceInfo(statA.device);
+    if (!diskA.known || !diskA.rotational) return false;
+    BlockDeviceInfo diskB = statB.device == statA.device ? diskA : blockDeviceInfo(statB.device);
+    return diskB.known && diskB.disk == diskA.disk;
 }
 
-// Check if paths are on the same filesystem (same drive on Windows)
+// One mapped extent of a file
+struct FileExtent {
+    std::uint64_t logical = 0;
+    std::uint64_t physical = 0;
+    std::uint64_t length = 0;
+};
+
+// Where a file's data lives on disk, from FIEMAP (Linux only; unknown elsewhere
+// or when the filesystem doesn't report stable addresses). Holes have no extent.
+struct ExtentMap {
+    bool known = false;
+    std::vector<FileExtent> extents;    // Sorted by logical offset
+
+    // Physical address behind a logical offset; false inside a hole
+    bool physicalAt(std::uint64_t logical, std::uint64_t& physical) const {
+        auto next = std::upper_bound(extents.begin(), extents.end(), logical,
+                                     [](std::uint64_t value, const FileExtent& e) { return value < e.logical; });
+        if (next == extents.begin()) return false;
+        const FileExtent& extent = *(next - 1);
+        if (logical >= extent.logical + extent.length) return false;
+        physical = extent.physical + (logical - extent.logical);
+        return true;
+    }
+
+    // Physically contiguous runs: a new run starts wherever an extent doesn't
+    // begin on disk right where the previous one ended
+    std::uint64_t runs() const {
+        std::uint64_t count = 0;
+        for (size_t i = 0; i < extents.size(); ++i) {
+            if (i == 0 || extents[i].physical != extents[i - 1].physical + extents[i - 1].length) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    std::uint64_t mappedBytes() const {
+        std::uint64_t bytes = 0;
+        for (const auto& extent : extents) {
+            bytes += extent.length;
+        }
+        return bytes;
+    }
+};
+
+ExtentMap readExtentMap(const IoFile& file, std::uint64_t size) {
+    ExtentMap map;
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+    std::vector<char> request(sizeof(struct fiemap) + FIEMAP_BATCH * sizeof(struct fiemap_extent));
+    std::uint64_t start = 0;
+    bool last = false;
+    while (!last && start < size) {
+        std::fill(request.begin(), request.end(), 0);
+        struct fiemap* fm = reinterpret_cast<struct fiemap*>(request.data());
+        fm->fm_start = start;
+        fm->fm_length = size - start;
+        fm->fm_flags = FIEMAP_FLAG_SYNC;    // Flush delayed allocations so every extent has an address
+        fm->fm_extent_count = FIEMAP_BATCH;
+        if (ioctl(file.fd(), FS_IOC_FIEMAP, fm) != 0) {
+            return ExtentMap();
+        }
+        if (fm->fm_mapped_extents == 0) break;
+
+        for (unsigned i = 0; i < fm->fm_mapped_extents; ++i) {
+            const struct fiemap_extent& fe = fm->fm_extents[i];
+            if (fe.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE)) {
+                return ExtentMap();  // No address to order by
+            }
+            map.extents.push_back({fe.fe_logical, fe.fe_physical, fe.fe_length});
+            start = fe.fe_logical + fe.fe_length;
+            last = (fe.fe_flags & FIEMAP_EXTENT_LAST) != 0;
+        }
+    }
+    map.known = true;
+#else
+    (void)file;
+    (void)size;
+#endif
+    return map;
+}
+
+// Keeps the page cache footprint of one sequentially accessed file bounded.
+// Output files get their dirty pages pushed to writeback every writebackInterval
+// bytes (sync_file_range), and both inputs and outputs drop pages that are
+// already processed (POSIX_FADV_DONTNEED). The wait on writeback always lags
+// one window behind, so the disk stays busy while the next window is filled.
+class CacheWindow {
+public:
+    // start is the first offset this window covers (range workers start mid-file)
+    CacheWindow(const IoFile& file, bool writing, const CachePolicy& policy, std::uint64_t start = 0)
+        : fd_(file.fd()), writing_(writing), interval_(policy.writebackInterval),
+          enabled_(policy.streaming() && file.fd() >= 0 && policy.writebackInterval > 0),
+          windowStart_(start), retiredEnd_(start) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+        if (enabled_ && !writing_) {
+            posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#endif
+    }
+
+    // Called after each chunk with the file's new offset
+    void advance(std::uint64_t position) {
+        if (!enabled_ || position - windowStart_ < interval_) return;
+
+        if (writing_) {
+            startWriteback(windowStart_, position - windowStart_);
+            retire(windowStart_);
+        } else {
+            retire(position);
+        }
+        windowStart_ = position;
+    }
+
+    // Flush and drop whatever is left once the file is complete
+    void finish(std::uint64_t position) {
+        if (!enabled_) return;
+        retire(position);
+        windowStart_ = position;
+    }
+
+private:
+    void startWriteback(std::uint64_t offset, std::uint64_t length) {
+#if defined(__linux__)
+        sync_file_range(fd_, static_cast<off_t>(offset), static_cast<off_t>(length), SYNC_FILE_RANGE_WRITE);
+#else
+        (void)offset;
+        (void)length;
+#endif
+    }
+
+    // Wait for writeback (outputs) and drop cached pages below end
+    void retire(std::uint64_t end) {
+        if (end <= retiredEnd_) return;
+        std::uint64_t length = end - retiredEnd_;
+#if defined(__linux__)
+        if (writing_) {
+            sync_file_range(fd_, static_cast<off_t>(retiredEnd_), static_cast<off_t>(length),
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        }
+#endif
+#if defined(POSIX_FADV_DONTNEED)
+        posix_fadvise(fd_, static_cast<off_t>(retiredEnd_), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+        (void)length;
+#endif
+        retiredEnd_ = end;
+    }
+
+    int fd_;
+    bool writing_;
+    std::uint64_t interval_;
+    bool enabled_;
+    std::uint64_t windowStart_;  // Start of the range not yet handed to writeback
+    std::uint64_t retiredEnd_;   // Everything from start below this has been flushed and dropped
+};
+
+
+// Process-wide pool of I/O buffers drawn from a single memory budget.
+// Swapping, hashing and any concurrent workers lease their buffers here, so
+// peak buffer memory never exceeds --max-memory. acquire() blocks until enough
+// of the budget is released (backpressure), and acquirePair() leases a pair in
+// one step; released blocks are kept for reuse and evicted only when a new
+// allocation needs their share of the budget.
+class BufferPool {
+public:
+    // RAII handle for one leased buffer; returns it to the pool on destruction
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(BufferPool* pool, char* data, size_t size) : pool_(pool), data_(data), size_(size) {}
+        ~Lease() { reset(); }
+
+        Lease(Lease&& other) noexcept : pool_(other.pool_), data_(other.data_), size_(other.size_) {
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                reset();
+                std::swap(pool_, other.pool_);
+                std::swap(data_, other.data_);
+                std::swap(size_, other.size_);
+            }
+            return *this;
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        void reset() {
+            if (pool_) pool_->release(data_);
+            pool_ = nullptr;
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        char* data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        BufferPool* pool_ = nullptr;
+        char* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    explicit BufferPool(std::uint64_t budget = DEFAULT_MAX_MEMORY) : budget_(budget) {}
+    ~BufferPool() { trim(0); }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Set the budget and allocation mode; call before any buffers are leased
+    void configure(std::uint64_t budget, bool hugePages) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        budget_ = budget;
+        hugePages_ = hugePages;
+        trimLocked(0);
+    }
+
+    std::uint64_t budget() const { return budget_; }
+    bool hugePages() const { return hugePages_; }
+
+    // Largest buffer size (aligned, at least minimum) such that `count` buffers fit in the budget
+    size_t fairShare(size_t requested, size_t count, size_t minimum = BUFFER_ALIGNMENT) const {
+        std::uint64_t share = budget_ / std::max<size_t>(count, 1);
+        share -= share % BUFFER_ALIGNMENT;
+        share = std::max<std::uint64_t>(share, minimum);
+        return static_cast<size_t>(std::min<std::uint64_t>(requested, share));
+    }
+
+    // Lease a buffer of exactly size bytes (clamped to the budget), waiting for budget if needed
+    Lease acquire(size_t size) {
+        size = static_cast<size_t>(std::min<std::uint64_t>(std::max<size_t>(size, 1), budget_));
+        size_t footprint = blockFootprint(size);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        // A released block of the same size can be reused without waiting
+        if (!reuseLocked(size)) {
+            // Backpressure: wait until in-use buffers leave room for this one
+            cv_.wait(lock, [&] { return inUse_ + footprint <= std::max<std::uint64_t>(budget_, footprint); });
+        }
+        Block block = takeLocked(size);
+        return Lease(this, block.data, block.size);
+    }
+
+    // Lease two buffers of size bytes (each clamped to half the budget) at
+    // once. Workers that need a pair must not hold one buffer while waiting
+    // for the other: with enough of them, every worker holds one and none can
+    // ever get its second.
+    std::pair<Lease, Lease> acquirePair(size_t size) {
+        size = static_cast<size_t>(std::min<std::uint64_t>(std::max<size_t>(size, 1), std::max<std::uint64_t>(budget_ / 2, 1)));
+        std::uint64_t footprint = 2 * static_cast<std::uint64_t>(blockFootprint(size));
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return inUse_ + footprint <= std::max<std::uint64_t>(budget_, footprint); });
+
+        Block first = takeLocked(size);
+        Block second;
+        try {
+            second = takeLocked(size);
+        } catch (...) {
+            releaseLocked(first.data);
+            throw;
+        }
+        return {Lease(this, first.data, first.size), Lease(this, second.data, second.size)};
+    }
+
+    // Bytes currently leased out
+    std::uint64_t inUse() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return inUse_;
+    }
+
+private:
+    struct Block {
+        char* data = nullptr;
+        size_t size = 0;
+        size_t footprint = 0;
+        bool mapped = false;
+    };
+
+    size_t blockFootprint(size_t size) const {
+        size_t align = (hugePages_ && size >= HUGE_PAGE_SIZE) ? HUGE_PAGE_SIZE : BUFFER_ALIGNMENT;
+        return (size + align - 1) / align * align;
+    }
+
+    Block allocateBlock(size_t size) {
+        Block block;
+        block.size = size;
+        block.footprint = blockFootprint(size);
+
+#if defined(__linux__)
+        if (hugePages_ && size >= HUGE_PAGE_SIZE) {
+            // Prefer explicit hugetlb pages; fall back to transparent huge pages
+            void* p = mmap(nullptr, block.footprint, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p == MAP_FAILED) {
+                p = mmap(nullptr, block.footprint, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p != MAP_FAILED) madvise(p, block.footprint, MADV_HUGEPAGE);
+            }
+            if (p != MAP_FAILED) {
+                block.data = static_cast<char*>(p);
+                block.mapped = true;
+                return block;
+            }
+        }
+#endif
+
+#ifdef _WIN32
+        block.data = static_cast<char*>(_aligned_malloc(block.footprint, BUFFER_ALIGNMENT));
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, BUFFER_ALIGNMENT, block.footprint) != 0) p = nullptr;
+        block.data = static_cast<char*>(p);
+#endif
+        if (!block.data) throw std::bad_alloc();
+        return block;
+    }
+
+    void freeBlock(const Block& block) {
+#if defined(__linux__)
+        if (block.mapped) {
+            munmap(block.data, block.footprint);
+            return;
+        }
+#endif
+#ifdef _WIN32
+        _aligned_free(block.data);
+#else
+        std::free(block.data);
+#endif
+    }
+
+    // Called with mutex_ held: whether a cached block of this size is free
+    bool reuseLocked(size_t size) const {
+        return std::any_of(freeBlocks_.begin(), freeBlocks_.end(), [&](const Block& b) { return b.size == size; });
+    }
+
+    // Called with mutex_ held once the budget has room: lease a cached block
+    // of the same size, or evict what no longer fits and allocate a new one
+    Block takeLocked(size_t size) {
+        for (auto it = freeBlocks_.begin(); it != freeBlocks_.end(); ++it) {
+            if (it->size == size) {
+                Block block = *it;
+                freeBlocks_.erase(it);
+                inUse_ += block.footprint;
+                cached_ -= block.footprint;
+                return block;
+            }
+        }
+
+        size_t footprint = blockFootprint(size);
+        trimLocked(budget_ - std::min<std::uint64_t>(budget_, inUse_ + footprint));
+
+        Block block = allocateBlock(size);
+        inUse_ += block.footprint;
+        blockInfo_.push_back(block);
+        return block;
+    }
+
+    void release(char* data) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            releaseLocked(data);
+        }
+        cv_.notify_all();
+    }
+
+    void releaseLocked(char* data) {
+        for (const Block& block : blockInfo_) {
+            if (block.data == data) {
+                inUse_ -= block.footprint;
+                cached_ += block.footprint;
+                freeBlocks_.push_back(block);
+                break;
+            }
+        }
+        trimLocked(budget_ - std::min(budget_, inUse_));
+    }
+
+    // Free cached blocks until at most `keep` bytes remain cached
+    void trim(std::uint64_t keep) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        trimLocked(keep);
+    }
+
+    void trimLocked(std::uint64_t keep) {
+        while (cached_ > keep && !freeBlocks_.empty()) {
+            Block block = freeBlocks_.back();
+            freeBlocks_.pop_back();
+            cached_ -= block.footprint;
+            blockInfo_.erase(std::remove_if(blockInfo_.begin(), blockInfo_.end(),
+                                            [&](const Block& b) { return b.data == block.data; }),
+                             blockInfo_.end());
+            freeBlock(block);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::uint64_t budget_;
+    bool hugePages_ = false;
+    std::uint64_t inUse_ = 0;
+    std::uint64_t cached_ = 0;
+    std::vector<Block> freeBlocks_;
+    std::vector<Block> blockInfo_;  // Every live block, leased or cached
+};
+
+// Set on daemon job runners, which each keep their own warm pool so that
+// concurrent jobs can't block each other waiting for budget
+thread_local BufferPool* jobBufferPool = nullptr;
+
+// The pool shared by every operation in this process (or this daemon runner)
+BufferPool& sharedBufferPool() {
+    if (jobBufferPool) return *jobBufferPool;
+    static BufferPool pool;
+    return pool;
+}
+
+// Path destination strategy types
+enum class PathStrategy {
+    SAME,       // Keep original path (default, swap in place)
+    REL,        // Preserve relative path on target drive
+    SAME_AS_1,  // Use file 1's path structure
+    SAME_AS_2,  // Use file 2's path structure
+    EXPLICIT    // User-specified path
+};
+
+// Struct to hold parsed destination info
+struct DestinationSpec {
+    PathStrategy strategy;
+    std::string explicitPath;  // Only used if strategy == EXPLICIT
+};
+
+// Set of actions that --yes can auto-confirm
+struct YesActions {
+    bool mkdir = false;
+    bool overwrite = false;
+    bool all = false;
+
+    bool shouldAutoMkdir() const { return mkdir || all; }
+    bool shouldAutoOverwrite() const { return overwrite || all; }
+};
+
+// Convert string to uppercase for case-insensitive comparison
+std::string toUpperCase(const std::string& str) {
+    std::string result = str;
+    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
+    return result;
+}
+
+// Parse --yes arguments into YesActions
+YesActions parseYesActions(const std::vector<std::string>& args) {
+    YesActions actions;
+
+    if (args.empty()) {
+        // Bare --yes means safe actions only (mkdir)
+        actions.mkdir = true;
+        return actions;
+    }
+
+    for (const auto& arg : args) {
+        std::string upper = toUpperCase(arg);
+        if (upper == "MKDIR") {
+            actions.mkdir = true;
+        } else if (upper == "OVERWRITE" || upper == "FORCE") {
+            actions.overwrite = true;
+        } else if (upper == "ALL") {
+            actions.all = true;
+        }
+    }
+
+    return actions;
+}
+
+// Parse destination specifier (--1-to or --2-to value)
+DestinationSpec parseDestination(const std::string& spec, int fileNum) {
+    DestinationSpec dest;
+    std::string upper = toUpperCase(spec);
+
+    if (upper == "SAME") {
+        dest.strategy = PathStrategy::SAME;
+    } else if (upper == "REL") {
+        dest.strategy = PathStrategy::REL;
+    } else if (upper == "SAME-AS-1") {
+        dest.strategy = PathStrategy::SAME_AS_1;
+    } else if (upper == "SAME-AS-2") {
+        dest.strategy = PathStrategy::SAME_AS_2;
+    } else {
+        // Treat as explicit path
+        dest.strategy = PathStrategy::EXPLICIT;
+        dest.explicitPath = spec;
+    }
+
+    // SAME-AS-SELF is equivalent to REL
+    if ((fileNum == 1 && dest.strategy == PathStrategy::SAME_AS_1) ||
+        (fileNum == 2 && dest.strategy == PathStrategy::SAME_AS_2)) {
+        dest.strategy = PathStrategy::REL;
+    }
+
+    return dest;
+}
+
+// Parse a byte size such as "4096", "64K", "64M" or "2G"
+std::uint64_t parseByteSize(const std::string& text) {
+    // std::stoull would wrap "-1" around to the largest value
+    size_t sign = text.find_first_not_of(" \t\n\v\f\r");
+    if (sign != std::string::npos && text[sign] == '-') {
+        throw std::invalid_argument("Invalid size: " + text);
+    }
+
+    size_t pos = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(text, &pos);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Invalid size: " + text);
+    }
+
+    std::string suffix = toUpperCase(text.substr(pos));
+    if (suffix == "B") suffix.clear();
+    if (!suffix.empty() && suffix.back() == 'B') suffix.pop_back();
+    if (!suffix.empty() && suffix.back() == 'I') suffix.pop_back();  // KiB, MiB, GiB
+
+    std::uint64_t multiplier = 1;
+    if (suffix == "K") multiplier = 1024ULL;
+    else if (suffix == "M") multiplier = 1024ULL * 1024;
+    else if (suffix == "G") multiplier = 1024ULL * 1024 * 1024;
+    else if (suffix == "T") multiplier = 1024ULL * 1024 * 1024 * 1024;
+    else if (!suffix.empty()) throw std::invalid_argument("Invalid size suffix: " + text);
+
+    if (value > UINT64_MAX / multiplier) throw std::invalid_argument("Size too large: " + text);
+    return static_cast<std::uint64_t>(value) * multiplier;
+}
+
+// Parse a --range-a/--range-b value, OFF:LEN with byte sizes (e.g. "1M:512K")
+FileRegion parseFileRegion(const std::string& text) {
+    size_t colon = text.find(':');
+    if (colon == std::string::npos) {
+        throw std::invalid_argument("Invalid range (expected OFF:LEN): " + text);
+    }
+    FileRegion region;
+    region.offset = parseByteSize(text.substr(0, colon));
+    region.length = parseByteSize(text.substr(colon + 1));
+    if (region.length == 0) {
+        throw std::invalid_argument("Range length must not be zero: " + text);
+    }
+    return region;
+}
+
+// Parse --cache-policy value
+CachePolicy parseCachePolicy(const std::string& mode, const std::string& writeback) {
+    CachePolicy policy;
+    std::string upper = toUpperCase(mode);
+
+    if (upper.empty() || upper == "NORMAL") {
+        policy.mode = CacheMode::NORMAL;
+    } else if (upper == "STREAM") {
+        policy.mode = CacheMode::STREAM;
+    } else {
+        throw std::invalid_argument("Unknown cache policy: " + mode + " (expected normal or stream)");
+    }
+
+    if (!writeback.empty()) {
+        policy.writebackInterval = parseByteSize(writeback);
+    }
+
+    return policy;
+}
+
+// Parse --large-extents MODE
+ExtentMode parseExtentMode(const std::string& mode) {
+    std::string upper = toUpperCase(mode);
+    if (upper.empty() || upper == "AUTO") return ExtentMode::AUTO;
+    if (upper == "ON") return ExtentMode::ON;
+    if (upper == "OFF") return ExtentMode::OFF;
+    throw std::invalid_argument("Unknown extent mode: " + mode + " (expected auto, on or off)");
+}
+
+// Parse the ALGO of --verify=ALGO
+VerifyAlgorithm parseVerifyAlgorithm(const std::string& name) {
+    std::string upper = toUpperCase(name);
+    if (upper.empty() || upper == "SHA256") return VerifyAlgorithm::SHA256;
+    if (upper == "CRC32C") return VerifyAlgorithm::CRC32C;
+    if (upper == "XXH3") return VerifyAlgorithm::XXH3;
+    throw std::invalid_argument("Unknown verify algorithm: " + name + " (expected crc32c, xxh3 or sha256)");
+}
+
+// Algorithm name for logs and --dry-run, with the CRC-32C or XXH3 implementation in use
+std::string verifyAlgorithmName(VerifyAlgorithm algorithm) {
+    switch (algorithm) {
+    case VerifyAlgorithm::CRC32C:
+        return std::string("crc32c (") + xmvsum::crc32cImplementation() + ")";
+    case VerifyAlgorithm::XXH3:
+#ifdef XMV_XXH3_DISPATCH
+        return "xxh3 (runtime dispatch)";
+#else
+        return "xxh3 (build-time ISA)";
+#endif
+    default:
+        return "sha256";
+    }
+}
+
+// Parse --sync value
+SyncPolicy parseSyncPolicy(const std::string& name) {
+    std::string upper = toUpperCase(name);
+    if (upper == "NONE") return SyncPolicy::NONE;
+    if (upper.empty() || upper == "END") return SyncPolicy::END;
+    if (upper == "PARANOID") return SyncPolicy::PARANOID;
+    throw std::invalid_argument("Unknown sync policy: " + name + " (expected none, end or paranoid)");
+}
+
+// Parse a duration such as "8ms", "100us" or "0.5s" (plain numbers are seconds) into seconds
+double parseDuration(const std::string& text) {
+    size_t pos = 0;
+    double value = 0;
+    try {
+        value = std::stod(text, &pos);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Invalid duration: " + text);
+    }
+
+    std::string suffix = text.substr(pos);
+    double scale = 1.0;
+    if (suffix == "ns") scale = 1e-9;
+    else if (suffix == "us") scale = 1e-6;
+    else if (suffix == "ms") scale = 1e-3;
+    else if (!suffix.empty() && suffix != "s") throw std::invalid_argument("Invalid duration suffix: " + text);
+
+    if (value < 0) throw std::invalid_argument("Invalid duration: " + text);
+    return value * scale;
+}
+
+// Parse --simulate SPEC: comma-separated bandwidth=SIZE (per second),
+// latency=TIME, queue=N and seek=TIME; unset keys keep their defaults
+xmvio::DeviceModel parseDeviceModel(const std::string& spec) {
+    xmvio::DeviceModel model;
+    std::vector<std::string> fields;
+    boost::algorithm::split(fields, spec, boost::algorithm::is_any_of(","));
+    for (const auto& field : fields) {
+        size_t eq = field.find('=');
+        std::string key = field.substr(0, eq);
+        std::string value = eq == std::string::npos ? std::string() : field.substr(eq + 1);
+        if (value.empty()) throw std::invalid_argument("Invalid device setting: " + field);
+
+        if (key == "bandwidth") {
+            model.bandwidth = static_cast<double>(parseByteSize(value));
+            if (model.bandwidth <= 0) throw std::invalid_argument("Device bandwidth must be positive");
+        } else if (key == "latency") {
+            model.latency = parseDuration(value);
+        } else if (key == "queue") {
+            std::uint64_t depth = parseByteSize(value);
+            if (depth < 1 || depth > 65536) throw std::invalid_argument("Device queue depth must be 1..65536");
+            model.queueDepth = static_cast<unsigned>(depth);
+        } else if (key == "seek") {
+            model.seekPenalty = parseDuration(value);
+        } else {
+            throw std::invalid_argument("Unknown device setting: " + key);
+        }
+    }
+    return model;
+}
+
+// Parse --checksum-cache MODE
+ChecksumStore parseChecksumStore(const std::string& mode) {
+    std::string upper = toUpperCase(mode);
+    if (upper.empty() || upper == "OFF") return ChecksumStore::OFF;
+    if (upper == "XATTR") return ChecksumStore::XATTR;
+    if (upper == "SIDECAR") return ChecksumStore::SIDECAR;
+    throw std::invalid_argument("Unknown checksum cache: " + mode + " (expected off, xattr or sidecar)");
+}
+
+// Get the relative path portion (without drive letter/root)
+fs::path getRelativePath(const fs::path& fullPath) {
+    // For Windows: C:\folder\file.bin -> folder\file.bin
+    // For Unix: /home/user/file.bin -> home/user/file.bin
+    fs::path rel = fullPath;
+    if (rel.has_root_name()) {
+        rel = fs::path(rel.string().substr(rel.root_name().string().length()));
+    }
+    if (rel.has_root_directory()) {
+        rel = rel.relative_path();
+    }
+    return rel;
+}
+
+// Get the drive/root portion of a path
+fs::path getDriveRoot(const fs::path& fullPath) {
+    // For Windows: C:\folder\file.bin -> C:\
+    // For Unix: /home/user/file.bin -> /
+    fs::path root;
+    if (fullPath.has_root_name()) {
+        root = fullPath.root_name();
+    }
+    if (fullPath.has_root_directory()) {
+        root /= fullPath.root_directory();
+    }
+    return root;
+}
+
+// Resolve final destination path based on strategy
+fs::path resolveDestination(const fs::path& sourceFile,
+                            const fs::path& otherFile,
+                            const DestinationSpec& destSpec,
+                            int /*fileNum*/) {
+    fs::path targetDrive = getDriveRoot(otherFile);
+
+    switch (destSpec.strategy) {
+        case PathStrategy::SAME:
+            // Keep original path
+            return sourceFile;
+
+        case PathStrategy::REL: {
+            // Preserve relative path on target drive
+            fs::path relPath = getRelativePath(sourceFile);
+            return targetDrive / relPath;
+        }
+
+        case PathStrategy::SAME_AS_1: {
+            // Use file 1's folder structure (caller ensures this isn't self-referential)
+            fs::path otherRel = getRelativePath(otherFile);
+            fs::path otherDir = otherRel.parent_path();
+            return targetDrive / otherDir / sourceFile.filename();
+        }
+
+        case PathStrategy::SAME_AS_2: {
+            // Use file 2's folder structure
+            fs::path otherRel = getRelativePath(otherFile);
+            fs::path otherDir = otherRel.parent_path();
+            return targetDrive / otherDir / sourceFile.filename();
+        }
+
+        case PathStrategy::EXPLICIT: {
+            // User-specified path
+            std::string pathStr = destSpec.explicitPath;
+
+            // Handle root specifier "/" or "\" - means root of target drive
+            if (pathStr == "/" || pathStr == "\\") {
+                return targetDrive / sourceFile.filename();
+            }
+
+#ifdef _WIN32
+            // Normalize forward slashes to backslashes on Windows
+            std::replace(pathStr.begin(), pathStr.end(), '/', '\\');
+#endif
+
+            fs::path explicitPath(pathStr);
+
+            // Check if it's a path starting with / or \ (relative to drive root)
+            if (!pathStr.empty() && (pathStr[0] == '\\' || pathStr[0] == '/')) {
+                // Path like "/staging" means targetDrive + staging
+                return targetDrive / explicitPath.relative_path() / sourceFile.filename();
+            }
+
+            if (explicitPath.is_absolute() && explicitPath.has_root_name()) {
+                // Fully absolute path with drive letter (e.g., D:\temp)
+                // Use as-is but append filename if it's a directory
+                if (explicitPath.extension().empty() && !explicitPath.filename_is_dot()) {
+                    return explicitPath / sourceFile.filename();
+                }
+                return explicitPath;
+            } else {
+                // Relative path - relative to target drive
+                return targetDrive / explicitPath / sourceFile.filename();
+            }
+        }
+    }
+
+    // Default fallback
+    return sourceFile;
+}
+
+// Prompt user for yes/no confirmation
+bool promptYesNo(const std::string& message, bool defaultYes = false) {
+    std::string prompt = message + (defaultYes ? " [Y/n]: " : " [y/N]: ");
+    std::cout << prompt;
+    std::cout.flush();
+
+    // Daemon jobs have no terminal; --yes answers for them
+    if (jobStdout) {
+        std::cout << (defaultYes ? "y" : "n") << " (no terminal)" << std::endl;
+        return defaultYes;
+    }
+
+    std::string response;
+    std::getline(std::cin, response);
+    boost::algorithm::trim(response);
+
+    if (response.empty()) {
+        return defaultYes;
+    }
+
+    char first = static_cast<char>(std::tolower(static_cast<unsigned char>(response[0])));
+    return (first == 'y');
+}
+
+#ifndef _WIN32
+// Device ID of a path, or of its nearest existing ancestor for paths not created yet
+bool getDeviceId(const fs::path& path, dev_t& device) {
+    fs::path probe = fs::absolute(path);
+    struct stat st;
+    while (!probe.empty()) {
+        if (stat(probe.string().c_str(), &st) == 0) {
+            device = st.st_dev;
+            return true;
+        }
+        if (!probe.has_parent_path() || probe.parent_path() == probe) break;
+        probe = probe.parent_path();
+    }
+    return false;
+}
+#endif
+
+// Check if paths are on the same filesystem (same drive on Windows)
 bool isSameFilesystem(const fs::path& path1, const fs::path& path2) {
+#ifndef _WIN32
+    // Every POSIX path shares the "/" root, so compare the mounted device instead
+    dev_t dev1, dev2;
+    if (getDeviceId(path1, dev1) && getDeviceId(path2, dev2)) {
+        return dev1 == dev2;
+    }
+#endif
     fs::path root1 = getDriveRoot(fs::absolute(path1));
     fs::path root2 = getDriveRoot(fs::absolute(path2));
     return root1 == root2;
 }
 
-// Function to calculate SHA-256 hash of a file
-std::string calculateSHA256(const std::string& filename) {
-    CryptoPP::SHA256 hash;
-    std::ifstream file(filename, std::ios::binary);
-    std::stringstream ss;
+// Result of an attempt to exchange two paths in one metadata operation
+enum class ExchangeResult {
+    DONE,           // Both names now point at each other's file
+    UNSUPPORTED,    // Kernel or filesystem can't do it; caller should fall back
+    FAILED          // Real error (permissions, missing file, ...)
+};
+
+// Atomically exchange two paths on the same filesystem:
+// renameat2(RENAME_EXCHANGE) on Linux, renamex_np(RENAME_SWAP) on macOS
+ExchangeResult exchangePaths(const fs::path& path1, const fs::path& path2) {
+#if defined(__linux__) && defined(SYS_renameat2) && defined(RENAME_EXCHANGE)
+    if (syscall(SYS_renameat2, AT_FDCWD, path1.c_str(), AT_FDCWD, path2.c_str(), RENAME_EXCHANGE) == 0) {
+        return ExchangeResult::DONE;
+    }
+    if (errno == EINVAL || errno == ENOSYS || errno == ENOTSUP || errno == EOPNOTSUPP) {
+        return ExchangeResult::UNSUPPORTED;
+    }
+    return ExchangeResult::FAILED;
+#elif defined(__APPLE__) && defined(RENAME_SWAP)
+    if (renamex_np(path1.c_str(), path2.c_str(), RENAME_SWAP) == 0) {
+        return ExchangeResult::DONE;
+    }
+    if (errno == EINVAL || errno == ENOTSUP) {
+        return ExchangeResult::UNSUPPORTED;
+    }
+    return ExchangeResult::FAILED;
+#else
+    (void)path1;
+    (void)path2;
+    return ExchangeResult::UNSUPPORTED;
+#endif
+}
+
+// Swap two paths on the same filesystem: one atomic exchange when supported,
+// otherwise three renames through a temporary name
+void renameSwap(const fs::path& path1, const fs::path& path2, bool verbose) {
+    XMV_TRACE_SPAN("exchange", 0);
+    ExchangeResult result = exchangePaths(path1, path2);
+    if (result == ExchangeResult::DONE) {
+        if (verbose) {
+            std::cout << "Exchanged paths atomically." << std::endl;
+        }
+        return;
+    }
+    if (result == ExchangeResult::FAILED) {
+        throw fs::filesystem_error("Unable to exchange paths", path1, path2,
+                                   boost::system::error_code(errno, boost::system::system_category()));
+    }
+
+    if (verbose) {
+        std::cout << "Atomic exchange not supported here; using temporary rename." << std::endl;
+    }
+    fs::path temp = path1.string() + ".xmv_temp";
+    fs::rename(path1, temp);
+    fs::rename(path2, path1);
+    fs::rename(temp, path2);
+}
+
+// Whole-file checksum for --verify, as hex
+// Streams the file through a pooled buffer instead of loading it whole
+std::string calculateChecksum(const std::string& filename, VerifyAlgorithm algorithm) {
+    CryptoPP::SHA256 sha;
+    std::uint32_t crc = 0;
+    std::unique_ptr<XXH3_state_t, XXH_errorcode (*)(XXH3_state_t*)> xxh(nullptr, XXH3_freeState);
+    if (algorithm == VerifyAlgorithm::XXH3) {
+        xxh.reset(XXH3_createState());
+        if (!xxh || XXH3_64bits_reset(xxh.get()) != XXH_OK) {
+            throw std::bad_alloc();
+        }
+    }
+    RawFile file(filename, RawFile::Mode::READ);
+
+    BufferPool& pool = sharedBufferPool();
+    BufferPool::Lease buffer = pool.acquire(pool.fairShare(HASH_BUFFER_SIZE, 1));
+
+    std::streamsize count;
+    std::uint64_t offset = 0;
+    while ((count = file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) > 0) {
+        XMV_TRACE_SPAN("hash", offset);
+        size_t length = static_cast<size_t>(count);
+        switch (algorithm) {
+        case VerifyAlgorithm::SHA256:
+            sha.Update(reinterpret_cast<const CryptoPP::byte*>(buffer.data()), length);
+            break;
+        case VerifyAlgorithm::CRC32C:
+            crc = xmvsum::crc32c(crc, buffer.data(), length);
+            break;
+        case VerifyAlgorithm::XXH3:
+#ifdef XMV_XXH3_DISPATCH
+            XXH3_64bits_update_dispatch(xxh.get(), buffer.data(), length);
+#else
+            XXH3_64bits_update(xxh.get(), buffer.data(), length);
+#endif
+            break;
+        }
+        offset += static_cast<std::uint64_t>(count);
+    }
+
+    std::string digest;
+    if (algorithm == VerifyAlgorithm::SHA256) {
+        digest.assign(CryptoPP::SHA256::DIGESTSIZE, 0);
+        sha.Final(reinterpret_cast<CryptoPP::byte*>(&digest[0]));
+    } else {
+        std::uint64_t value = algorithm == VerifyAlgorithm::CRC32C ? crc : XXH3_64bits_digest(xxh.get());
+        int bytes = algorithm == VerifyAlgorithm::CRC32C ? 4 : 8;
+        for (int i = bytes - 1; i >= 0; --i) {
+            digest.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    return boost::algorithm::hex(digest);
+}
+
+// Record how --verify checked a swap. Written whenever there is a log, not
+// only with --verbose, so a later audit can tell what was actually compared.
+void logVerification(std::ofstream& log, bool verbose, const std::string& fileA, const std::string& fileB,
+                     const std::string& method) {
+    std::string message = "Verified " + fileA + " <-> " + fileB + " with " + method + ".";
+    if (verbose) std::cout << message << std::endl;
+    if (log) log << message << std::endl;
+}
+
+// Per-chunk digest table for one file: a truncated SHA-256 of every
+// DIGEST_CHUNK_SIZE chunk, plus the size, mtime and inode it was computed for.
+// A table whose validators don't match the file's current stat is ignored.
+struct ChunkDigests {
+    std::uint64_t chunkSize = DIGEST_CHUNK_SIZE;
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::uint64_t inode = 0;
+    std::vector<std::string> chunks;   // Binary digests, CHUNK_DIGEST_BYTES each
+
+    // True if the table still describes the file with this stat
+    bool describes(const FileStat& st) const {
+        return st.exists && st.size == size && st.mtimeNs == mtimeNs && st.inode == inode &&
+               chunks.size() == (size + chunkSize - 1) / chunkSize;
+    }
+
+    // True if both tables cover the same content
+    bool sameContent(const ChunkDigests& other) const {
+        return size == other.size && chunkSize == other.chunkSize && chunks == other.chunks;
+    }
+
+    // Number of chunks whose digests differ (a size difference counts every chunk)
+    size_t countDifferences(const ChunkDigests& other) const {
+        if (size != other.size || chunkSize != other.chunkSize || chunks.size() != other.chunks.size()) {
+            return std::max(chunks.size(), other.chunks.size());
+        }
+        size_t differing = 0;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if (chunks[i] != other.chunks[i]) ++differing;
+        }
+        return differing;
+    }
+
+    // True if every chunk touching [offset, offset + length) has the same
+    // digest in both tables
+    bool sameRange(const ChunkDigests& other, std::uint64_t offset, std::uint64_t length) const {
+        if (length == 0 || chunkSize != other.chunkSize) return false;
+        for (std::uint64_t i = offset / chunkSize; i <= (offset + length - 1) / chunkSize; ++i) {
+            if (i >= chunks.size() || i >= other.chunks.size() || chunks[i] != other.chunks[i]) return false;
+        }
+        return true;
+    }
+
+    // Point the table at a file that now holds this content
+    void bindTo(const FileStat& st) {
+        mtimeNs = st.mtimeNs;
+        inode = st.inode;
+    }
+};
+
+// Builds a ChunkDigests table from data fed in order, in pieces of any size
+class ChunkDigester {
+public:
+    void update(const char* data, std::streamsize count) {
+        while (count > 0) {
+            std::uint64_t take = std::min<std::uint64_t>(static_cast<std::uint64_t>(count),
+                                                         DIGEST_CHUNK_SIZE - filled_);
+            hash_.Update(reinterpret_cast<const CryptoPP::byte*>(data), static_cast<size_t>(take));
+            filled_ += take;
+            total_ += take;
+            data += take;
+            count -= static_cast<std::streamsize>(take);
+            if (filled_ == DIGEST_CHUNK_SIZE) flushChunk();
+        }
+    }
+
+    ChunkDigests finish() {
+        if (filled_ > 0) flushChunk();
+        result_.size = total_;
+        return result_;
+    }
+
+private:
+    void flushChunk() {
+        std::string digest(CryptoPP::SHA256::DIGESTSIZE, 0);
+        hash_.Final(reinterpret_cast<CryptoPP::byte*>(&digest[0]));  // Final also restarts the hash
+        digest.resize(CHUNK_DIGEST_BYTES);
+        result_.chunks.push_back(digest);
+        filled_ = 0;
+    }
+
+    CryptoPP::SHA256 hash_;
+    std::uint64_t filled_ = 0;
+    std::uint64_t total_ = 0;
+    ChunkDigests result_;
+};
+
+// Read a whole file and build its digest table; false on read error
+bool computeChunkDigests(const std::string& filename, ChunkDigests& out) {
+    RawFile file(filename, RawFile::Mode::READ);
+    if (!file.isOpen()) return false;
+
+    BufferPool& pool = sharedBufferPool();
+    BufferPool::Lease buffer = pool.acquire(pool.fairShare(HASH_BUFFER_SIZE, 1));
+
+    ChunkDigester digester;
+    std::streamsize count;
+    std::uint64_t offset = 0;
+    while ((count = file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) > 0) {
+        XMV_TRACE_SPAN("digest", offset);
+        digester.update(buffer.data(), count);
+        offset += static_cast<std::uint64_t>(count);
+    }
+    if (count < 0) return false;
+
+    out = digester.finish();
+    return true;
+}
+
+// Text form: one header line, then one hex digest per line
+std::string serializeChunkDigests(const ChunkDigests& table) {
+    std::ostringstream out;
+    out << "xmv-sums " << CHECKSUM_FORMAT << " " << table.chunkSize << " " << table.size << " "
+        << table.mtimeNs << " " << table.inode << "\n";
+    for (const auto& chunk : table.chunks) {
+        out << boost::algorithm::hex(chunk) << "\n";
+    }
+    return out.str();
+}
+
+bool parseChunkDigests(const std::string& text, ChunkDigests& out) {
+    std::istringstream in(text);
+    std::string magic;
+    int format = 0;
+    ChunkDigests table;
+    if (!(in >> magic >> format >> table.chunkSize >> table.size >> table.mtimeNs >> table.inode) ||
+        magic != "xmv-sums" || format != CHECKSUM_FORMAT || table.chunkSize == 0) {
+        return false;
+    }
+
+    std::string line;
+    while (in >> line) {
+        if (line.size() != CHUNK_DIGEST_BYTES * 2) return false;
+        try {
+            table.chunks.push_back(boost::algorithm::unhex(line));
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    out = table;
+    return true;
+}
+
+bool readChecksumXattr(const std::string& filename, std::string& value) {
+#if defined(__linux__) || defined(__APPLE__)
+#if defined(__APPLE__)
+    ssize_t length = getxattr(filename.c_str(), CHECKSUM_XATTR_NAME, nullptr, 0, 0, 0);
+#else
+    ssize_t length = getxattr(filename.c_str(), CHECKSUM_XATTR_NAME, nullptr, 0);
+#endif
+    if (length <= 0) return false;
+    value.resize(static_cast<size_t>(length));
+#if defined(__APPLE__)
+    length = getxattr(filename.c_str(), CHECKSUM_XATTR_NAME, &value[0], value.size(), 0, 0);
+#else
+    length = getxattr(filename.c_str(), CHECKSUM_XATTR_NAME, &value[0], value.size());
+#endif
+    if (length < 0) return false;
+    value.resize(static_cast<size_t>(length));
+    return true;
+#else
+    (void)filename;
+    (void)value;
+    return false;
+#endif
+}
+
+// False if the filesystem has no user xattrs or the table is too large for one
+bool writeChecksumXattr(const std::string& filename, const std::string& value) {
+#if defined(__APPLE__)
+    return setxattr(filename.c_str(), CHECKSUM_XATTR_NAME, value.data(), value.size(), 0, 0) == 0;
+#elif defined(__linux__)
+    return setxattr(filename.c_str(), CHECKSUM_XATTR_NAME, value.data(), value.size(), 0) == 0;
+#else
+    (void)filename;
+    (void)value;
+    return false;
+#endif
+}
+
+// Load the cached table for a file; false if there is none or it is stale
+bool loadChunkDigests(const std::string& filename, const FileStat& st, ChecksumStore store, ChunkDigests& out) {
+    if (store == ChecksumStore::OFF) return false;
+
+    std::string text;
+    ChunkDigests table;
+    if (readChecksumXattr(filename, text) && parseChunkDigests(text, table) && table.describes(st)) {
+        out = table;
+        return true;
+    }
+
+    std::ifstream sidecar(filename + CHECKSUM_SIDECAR_SUFFIX, std::ios::binary);
+    if (sidecar) {
+        std::stringstream content;
+        content << sidecar.rdbuf();
+        if (parseChunkDigests(content.str(), table) && table.describes(st)) {
+            out = table;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Store a table for a file; a failure only costs a rehash next time
+bool saveChunkDigests(const std::string& filename, const ChunkDigests& table, ChecksumStore store) {
+    if (store == ChecksumStore::OFF) return false;
+
+    std::string text = serializeChunkDigests(table);
+    std::string sidecarPath = filename + CHECKSUM_SIDECAR_SUFFIX;
+    if (store == ChecksumStore::XATTR && writeChecksumXattr(filename, text)) {
+        boost::system::error_code ec;
+        fs::remove(sidecarPath, ec);  // Superseded by the xattr
+        return true;
+    }
+
+    std::ofstream sidecar(sidecarPath, std::ios::binary | std::ios::trunc);
+    sidecar << text;
+    return static_cast<bool>(sidecar);
+}
+
+// Swap two small files entirely in memory.
+// Each file is read with one call and its new content written to "<file>.temp"
+// with one call, which skips the chunked engine, its buffers and the
+// free-space query. As on the chunked path, the originals are only replaced by
+// renaming the synced temp copies over them, so a crash at any point leaves
+// every original byte in either the file itself or the other file's temp copy.
+bool smallFileSwap(const std::string& fileA, const std::string& fileB,
+                   const FileStat& statA, const FileStat& statB, const SwapOptions& options) {
+    RawFile inA(fileA, RawFile::Mode::READ);
+    RawFile inB(fileB, RawFile::Mode::READ);
+    if (!inA.isOpen() || !inB.isOpen()) {
+        std::cerr << "Error: Unable to open files for swapping." << std::endl;
+        return false;
+    }
+
+    // Read one byte past the expected size to notice files that grew since stat
+    std::vector<char> dataA(static_cast<size_t>(statA.size) + 1);
+    std::vector<char> dataB(static_cast<size_t>(statB.size) + 1);
+    std::streamsize countA = inA.read(dataA.data(), static_cast<std::streamsize>(dataA.size()));
+    std::streamsize countB = inB.read(dataB.data(), static_cast<std::streamsize>(dataB.size()));
+    inA.close();
+    inB.close();
+    if (countA != static_cast<std::streamsize>(statA.size) || countB != static_cast<std::streamsize>(statB.size)) {
+        std::cerr << "Error: Files changed while swapping; original files are unchanged." << std::endl;
+        return false;
+    }
+    dataA.resize(static_cast<size_t>(countA));
+    dataB.resize(static_cast<size_t>(countB));
+
+    // fileA.temp gets B's content and fileB.temp gets A's
+    const std::string tempA = fileA + ".temp";
+    const std::string tempB = fileB + ".temp";
+    auto writeTemp = [&](const std::string& path, const std::vector<char>& data) {
+        RawFile out(path, RawFile::Mode::WRITE);
+        if (!out.isOpen() || !out.write(data.data(), static_cast<std::streamsize>(data.size()))) return false;
+        if (options.sync != SyncPolicy::NONE && !out.sync()) return false;
+        if (!options.verify) return true;
+
+        // Read back and compare with the in-memory original
+        std::vector<char> check(data.size() + 1);
+        RawFile in(path, RawFile::Mode::READ);
+        return in.isOpen() && in.read(check.data(), static_cast<std::streamsize>(check.size())) ==
+                                  static_cast<std::streamsize>(data.size()) &&
+               std::equal(data.begin(), data.end(), check.begin());
+    };
+    if (!writeTemp(tempA, dataB) || !writeTemp(tempB, dataA)) {
+        boost::system::error_code ec;
+        fs::remove(tempA, ec);
+        fs::remove(tempB, ec);
+        std::cerr << "Error: " << (options.verify ? "I/O failure or integrity check failure" : "I/O failure")
+                  << " during swap; original files are unchanged." << std::endl;
+        return false;
+    }
+
+    {
+        XMV_TRACE_SPAN("rename", 0);
+        fs::rename(tempA, fileA);
+        fs::rename(tempB, fileB);
+    }
+    if (!noteRename(options, tempA, fileA) || !noteRename(options, tempB, fileB)) {
+        std::cerr << "Error: Unable to flush the renames to disk." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// XOR swap two equally sized buffers in place (fixed-size kernels, see xor_kernels.h)
+void xorSwapBuffers(char* bufferA, char* bufferB, std::streamsize count) {
+    xorkernels::swapBuffers(bufferA, bufferB, static_cast<size_t>(count));
+}
+
+// Output writes for the swap engine. With --sparse, SPARSE_BLOCK_SIZE blocks
+// (aligned to file offsets) that are entirely zero are not written: fresh
+// outputs keep them as holes, and in-place rewrites punch them. Range workers
+// share one writer, so the count covers the whole swap.
+class SparseWriter {
+public:
+    explicit SparseWriter(bool enabled) : enabled_(enabled) {}
+
+    bool enabled() const { return enabled_; }
+    std::uint64_t sparsified() const { return sparsified_.load(); }
+
+    // Write count bytes at offset. punch is for outputs that already hold data
+    // there; without it the skipped blocks must already read as zeros.
+    bool writeAt(IoFile& out, const char* data, std::streamsize count, std::uint64_t offset, bool punch = false) {
+        if (!enabled_) return out.writeAt(data, count, offset);
+
+        const std::uint64_t total = static_cast<std::uint64_t>(count);
+        std::uint64_t pos = 0;
+        while (pos < total) {
+            // Grow a run of blocks that are all zero or all not
+            bool zero = false;
+            std::uint64_t end = pos;
+            while (end < total) {
+                std::uint64_t blockEnd = ((offset + end) / SPARSE_BLOCK_SIZE + 1) * SPARSE_BLOCK_SIZE;
+                std::uint64_t next = std::min(total, blockEnd - offset);
+                bool blockZero = xorkernels::isZero(data + end, static_cast<size_t>(next - end));
+                if (end > pos && blockZero != zero) break;
+                zero = blockZero;
+                end = next;
+            }
+
+            std::streamsize length = static_cast<std::streamsize>(end - pos);
+            if (!zero || (punch && !out.punchHole(offset + pos, end - pos))) {
+                if (!out.writeAt(data + pos, length, offset + pos)) return false;
+            } else {
+                sparsified_ += end - pos;
+            }
+            pos = end;
+        }
+        return true;
+    }
+
+private:
+    bool enabled_;
+    std::atomic<std::uint64_t> sparsified_{0};
+};
+
+// Report what --sparse saved, on screen and in the log
+void reportSparse(std::ofstream& log, const SparseWriter& writer) {
+    if (!writer.enabled()) return;
+    std::string message = "Sparse: " + std::to_string(writer.sparsified()) + " zero bytes left as holes.";
+    std::cout << message << std::endl;
+    if (log) log << message << std::endl;
+}
+
+// Stream both inputs front to back into the outputs with one pair of buffers.
+// digestA/digestB, when given, are fed each input's data for the checksum cache.
+bool sequentialSwapData(IoFile& inA, IoFile& inB, IoFile& outA, IoFile& outB, SparseWriter& writer,
+                        std::streamsize chunkSize, const SwapOptions& options, ProgressBar* progressBar,
+                        ChunkDigester* digestA, ChunkDigester* digestB) {
+    // Page cache hygiene (no-op unless --cache-policy stream)
+    CacheWindow cacheInA(inA, false, options.cache);
+    CacheWindow cacheInB(inB, false, options.cache);
+    CacheWindow cacheOutA(outA, true, options.cache);
+    CacheWindow cacheOutB(outB, true, options.cache);
+
+    // Perform XOR swap
+    BufferPool& pool = sharedBufferPool();
+    std::pair<BufferPool::Lease, BufferPool::Lease> leases = pool.acquirePair(static_cast<size_t>(chunkSize));
+    char* bufferA = leases.first.data();
+    char* bufferB = leases.second.data();
+
+    std::uint64_t readOffset = 0;
+    std::uint64_t writtenA = 0;
+    std::uint64_t writtenB = 0;
+    bool ioError = false;
+
+    // Read both files chunk by chunk until both are exhausted
+    while (true) {
+        std::streamsize countA;
+        std::streamsize countB;
+        {
+            XMV_TRACE_SPAN("read A", readOffset);
+            countA = inA.read(bufferA, chunkSize);
+        }
+        {
+            XMV_TRACE_SPAN("read B", readOffset);
+            countB = inB.read(bufferB, chunkSize);
+        }
+
+        if (countA < 0 || countB < 0) {
+            ioError = true;
+            break;
+        }
+
+        // Stop when both files are exhausted
+        if (countA == 0 && countB == 0)
+            break;
+
+        if (digestA || digestB) {
+            XMV_TRACE_SPAN("digest", readOffset);
+            if (digestA)
+                digestA->update(bufferA, countA);
+            if (digestB)
+                digestB->update(bufferB, countB);
+        }
+
+        // Process up to the larger count for XOR (zero-pad shorter in memory only)
+        std::streamsize maxCount = std::max(countA, countB);
+
+        // Zero-pad in memory if one file is shorter (for XOR operation only)
+        if (countA < maxCount)
+            std::fill(bufferA + countA, bufferA + maxCount, 0);
+        if (countB < maxCount)
+            std::fill(bufferB + countB, bufferB + maxCount, 0);
+
+        // XOR swap the buffers
+        {
+            XMV_TRACE_SPAN("xor", readOffset);
+            xorSwapBuffers(bufferA, bufferB, maxCount);
+        }
+
+        // Write swapped content with original sizes (bufferA now has B's content, bufferB has A's)
+        bool written;
+        {
+            XMV_TRACE_SPAN("write", readOffset);
+            written = writer.writeAt(outA, bufferA, countB, writtenA) &&
+                      writer.writeAt(outB, bufferB, countA, writtenB);
+        }
+        if (!written) {
+            ioError = true;
+            break;
+        }
+
+        readOffset += static_cast<std::uint64_t>(maxCount);
+        writtenA += static_cast<std::uint64_t>(countB);
+        writtenB += static_cast<std::uint64_t>(countA);
+
+        cacheInA.advance(readOffset);
+        cacheInB.advance(readOffset);
+        cacheOutA.advance(writtenA);
+        cacheOutB.advance(writtenB);
+
+        if (progressBar)
+            ++(*progressBar);
+    }
+
+    cacheInA.finish(readOffset);
+    cacheInB.finish(readOffset);
+    cacheOutA.finish(writtenA);
+    cacheOutB.finish(writtenB);
+
+    // Holes at the end of an output don't extend it
+    if (!ioError && writer.enabled()) {
+        ioError = !outA.truncate(writtenA) || !outB.truncate(writtenB);
+    }
+
+    return !ioError;
+}
+
+// Records which byte ranges of a swap have been completed, so a parallel run
+// can prove every byte of [0, total) was written before anything is renamed
+class RangeTracker {
+public:
+    void markDone(std::uint64_t begin, std::uint64_t end) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.emplace_back(begin, end);
+    }
+
+    // True if the completed ranges cover [0, total) with no gaps
+    bool covers(std::uint64_t total) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::sort(done_.begin(), done_.end());
+        std::uint64_t reached = 0;
+        for (const auto& range : done_) {
+            if (range.first > reached) break;
+            reached = std::max(reached, range.second);
+        }
+        return reached >= total;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> done_;
+};
+
+// Number of range workers worth starting: at most the requested threads, and
+// each worker should get at least a few chunks of its own
+unsigned rangeWorkerCount(unsigned requested, std::uint64_t total, std::uint64_t chunkSize) {
+#ifdef _WIN32
+    (void)requested;
+    (void)total;
+    (void)chunkSize;
+    return 1;  // Positional I/O is emulated with seek+read there, which isn't thread-safe
+#else
+    std::uint64_t byWork = total / (chunkSize * 4);
+    return static_cast<unsigned>(std::max<std::uint64_t>(1, std::min<std::uint64_t>(requested, byWork)));
+#endif
+}
+
+// A logical byte range [first, second) of a swap
+using ByteRange = std::pair<std::uint64_t, std::uint64_t>;
+
+// Chunk-aligned ranges covering [0, total), sorted by where the more
+// fragmented input keeps them on disk; the other input's reads are mostly
+// sequential anyway. Chunks in holes need no seek and go last, in logical
+// order. Empty if neither layout is known or there is nothing to reorder.
+std::vector<ByteRange> physicalOrderRanges(const ExtentMap& mapA, const ExtentMap& mapB,
+                                           std::uint64_t total, std::uint64_t chunk) {
+    std::vector<ByteRange> ranges;
+    if (!mapA.known && !mapB.known) return ranges;
+    const ExtentMap& key = !mapB.known || (mapA.known && mapA.runs() >= mapB.runs()) ? mapA : mapB;
+
+    // (physical address, logical offset) per chunk
+    const std::uint64_t noAddress = UINT64_MAX;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> chunks;
+    chunks.reserve(static_cast<size_t>((total + chunk - 1) / chunk));
+    for (std::uint64_t offset = 0; offset < total; offset += chunk) {
+        std::uint64_t physical = noAddress;
+        key.physicalAt(offset, physical);
+        chunks.emplace_back(physical, offset);
+    }
+    std::sort(chunks.begin(), chunks.end());
+
+    // Merge chunks that are neighbours both in this order and in the file
+    for (const auto& entry : chunks) {
+        std::uint64_t end = std::min(total, entry.second + chunk);
+        if (!ranges.empty() && ranges.back().second == entry.second) {
+            ranges.back().second = end;
+        } else {
+            ranges.emplace_back(entry.second, end);
+        }
+    }
+    if (ranges.size() <= 1) ranges.clear();  // Already in logical order
+    return ranges;
+}
+
+// Swap [0, max(sizeA, sizeB)) split into one contiguous range per worker, or,
+// given physically ordered ranges, into consecutive slices of that order with
+// about the same number of bytes each.
+// Workers share the four descriptors and use positional reads/writes; each
+// output is preallocated to its final size (only sized with --sparse, so
+// skipped blocks stay holes), and writes past an output's final size are
+// clipped, so files of different sizes come out exact.
+bool parallelSwapData(IoFile& inA, IoFile& inB, IoFile& outA, IoFile& outB, SparseWriter& writer,
+                      std::uint64_t sizeA, std::uint64_t sizeB, std::uint64_t chunk,
+                      unsigned workers, const std::vector<ByteRange>& ordered,
+                      const SwapOptions& options, ProgressBar* progressBar) {
+    // outA receives B's content and outB receives A's
+    if (writer.enabled() ? !outA.truncate(sizeB) || !outB.truncate(sizeA)
+                         : !outA.preallocate(sizeB) || !outB.preallocate(sizeA)) {
+        return false;
+    }
+
+    BufferPool& pool = sharedBufferPool();
+    const std::uint64_t total = std::max(sizeA, sizeB);
+
+    // Every worker's share is a whole multiple of the chunk size
+    std::uint64_t share = (total + workers - 1) / workers;
+    share = (share + chunk - 1) / chunk * chunk;
+
+    std::vector<std::vector<ByteRange>> assignments(workers);
+    if (ordered.empty()) {
+        for (unsigned w = 0; w < workers && w * share < total; ++w) {
+            assignments[w].emplace_back(w * share, std::min(total, (w + 1) * share));
+        }
+    } else {
+        unsigned w = 0;
+        std::uint64_t filled = 0;
+        for (ByteRange range : ordered) {
+            while (range.first < range.second) {
+                std::uint64_t take = range.second - range.first;
+                if (w + 1 < workers) {
+                    take = std::min(take, share - filled);
+                }
+                assignments[w].emplace_back(range.first, range.first + take);
+                range.first += take;
+                filled += take;
+                if (filled >= share && w + 1 < workers) {
+                    ++w;
+                    filled = 0;
+                }
+            }
+        }
+    }
+
+    RangeTracker tracker;
+    std::atomic<bool> failed(false);
+    std::mutex progressMutex;
+
+    auto worker = [&](const std::vector<ByteRange>& ranges) {
+        std::pair<BufferPool::Lease, BufferPool::Lease> leases = pool.acquirePair(static_cast<size_t>(chunk));
+        char* bufferA = leases.first.data();
+        char* bufferB = leases.second.data();
+
+        for (const ByteRange& range : ranges) {
+            if (failed) break;
+            const std::uint64_t begin = range.first;
+            const std::uint64_t end = range.second;
+
+            // Each range is streamed front to back, so it gets its own cache windows
+            CacheWindow cacheInA(inA, false, options.cache, begin);
+            CacheWindow cacheInB(inB, false, options.cache, begin);
+            CacheWindow cacheOutA(outA, true, options.cache, std::min(begin, sizeB));
+            CacheWindow cacheOutB(outB, true, options.cache, std::min(begin, sizeA));
+
+            std::uint64_t offset = begin;
+            while (offset < end && !failed) {
+                std::streamsize count = static_cast<std::streamsize>(std::min(chunk, end - offset));
+
+                // Each input only has data up to its own size
+                std::streamsize wantA = static_cast<std::streamsize>(offset < sizeA ? std::min<std::uint64_t>(count, sizeA - offset) : 0);
+                std::streamsize wantB = static_cast<std::streamsize>(offset < sizeB ? std::min<std::uint64_t>(count, sizeB - offset) : 0);
+                std::streamsize countA;
+                std::streamsize countB;
+                {
+                    XMV_TRACE_SPAN("read A", offset);
+                    countA = wantA > 0 ? inA.readAt(bufferA, wantA, offset) : 0;
+                }
+                {
+                    XMV_TRACE_SPAN("read B", offset);
+                    countB = wantB > 0 ? inB.readAt(bufferB, wantB, offset) : 0;
+                }
+                if (countA != wantA || countB != wantB) {
+                    failed = true;  // Read error, or an input shrank during the swap
+                    break;
+                }
+
+                std::fill(bufferA + countA, bufferA + count, 0);
+                std::fill(bufferB + countB, bufferB + count, 0);
+                {
+                    XMV_TRACE_SPAN("xor", offset);
+                    xorSwapBuffers(bufferA, bufferB, count);
+                }
+
+                // bufferA now has B's content (countB bytes valid), bufferB has A's
+                bool written;
+                {
+                    XMV_TRACE_SPAN("write", offset);
+                    written = (countB == 0 || writer.writeAt(outA, bufferA, countB, offset)) &&
+                              (countA == 0 || writer.writeAt(outB, bufferB, countA, offset));
+                }
+                if (!written) {
+                    failed = true;
+                    break;
+                }
+
+                offset += static_cast<std::uint64_t>(count);
+                cacheInA.advance(offset);
+                cacheInB.advance(offset);
+                cacheOutA.advance(std::min(offset, sizeB));
+                cacheOutB.advance(std::min(offset, sizeA));
+                tracker.markDone(offset - static_cast<std::uint64_t>(count), offset);
+
+                if (progressBar) {
+                    std::lock_guard<std::mutex> lock(progressMutex);
+                    ++(*progressBar);
+                }
+            }
+
+            cacheInA.finish(offset);
+            cacheInB.finish(offset);
+            cacheOutA.finish(std::min(offset, sizeB));
+            cacheOutB.finish(std::min(offset, sizeA));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (const auto& ranges : assignments) {
+        if (!ranges.empty()) {
+            threads.emplace_back(worker, std::cref(ranges));
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return !failed && tracker.covers(total);
+}
+
+// How the data engine runs one pair
+struct EngineLayout {
+    std::uint64_t chunk = 0;
+    unsigned workers = 1;
+    std::vector<ByteRange> ordered;     // Physically ordered ranges; empty for logical order
+
+    bool ranged() const { return workers > 1 || !ordered.empty(); }
+};
+
+// Split large files across range workers; a single worker streams sequentially
+// with baseChunk-sized chunks. Range workers always use large chunks, shared
+// out of the memory budget. With largeExtents (a shared spinning disk), a
+// single worker stages large extents instead so each file is read or written
+// in one long run before moving to the next.
+EngineLayout chooseEngineLayout(const IoFile& inA, const IoFile& inB, std::uint64_t sizeA, std::uint64_t sizeB,
+                                bool largeExtents, std::streamsize baseChunk, const SwapOptions& options) {
+    EngineLayout layout;
+    std::uint64_t largest = std::max(sizeA, sizeB);
+    layout.chunk = static_cast<std::uint64_t>(baseChunk);
+    layout.workers = largeExtents ? 1 : rangeWorkerCount(options.threads, largest, CHUNK_SIZE_SECURE);
+
+    // Every range worker holds two chunks of at least BUFFER_ALIGNMENT at once
+    std::uint64_t fitsBudget = sharedBufferPool().budget() / (2 * BUFFER_ALIGNMENT);
+    if (layout.workers > fitsBudget) {
+        layout.workers = static_cast<unsigned>(std::max<std::uint64_t>(fitsBudget, 1));
+        if (options.verbose) {
+            std::cout << "Using " << layout.workers << " range workers (--max-memory too small for more)" << std::endl;
+        }
+    }
+    if (largeExtents) {
+        layout.chunk = sharedBufferPool().fairShare(static_cast<size_t>(LARGE_EXTENT_SIZE), 2);
+        if (options.verbose) {
+            std::cout << "Using " << layout.chunk << "-byte extents"
+                      << (options.extents == ExtentMode::ON ? "" : " (shared rotational disk)") << std::endl;
+        }
+    } else if (layout.workers > 1 || options.physicalOrder) {
+        layout.chunk = sharedBufferPool().fairShare(static_cast<size_t>(CHUNK_SIZE_SECURE), 2 * layout.workers);
+    }
+
+    // With --physical-order, the range engine visits chunks in on-disk order
+    // (even with one worker) when FIEMAP shows the inputs are fragmented
+    if (options.physicalOrder) {
+        layout.ordered = physicalOrderRanges(readExtentMap(inA, sizeA), readExtentMap(inB, sizeB),
+                                             largest, layout.chunk);
+        if (options.verbose) {
+            if (layout.ordered.empty()) {
+                std::cout << "Physical order: inputs already sequential or layout unknown" << std::endl;
+            } else {
+                std::cout << "Physical order: " << layout.ordered.size() << " ranges" << std::endl;
+            }
+        }
+    }
+    return layout;
+}
+
+// Swap the data of two open inputs into two outputs with the chosen layout.
+// The digesters (sequential layout only) see each input's bytes as they are read.
+bool runSwapEngine(IoFile& inA, IoFile& inB, IoFile& outA, IoFile& outB, SparseWriter& writer,
+                   std::uint64_t sizeA, std::uint64_t sizeB, const EngineLayout& layout, const SwapOptions& options,
+                   ProgressBar* progressBar, ChunkDigester* digestA, ChunkDigester* digestB) {
+    if (layout.ranged()) {
+        return parallelSwapData(inA, inB, outA, outB, writer, sizeA, sizeB, layout.chunk, layout.workers,
+                                layout.ordered, options, progressBar);
+    }
+    return sequentialSwapData(inA, inB, outA, outB, writer, static_cast<std::streamsize>(layout.chunk), options,
+                              progressBar, digestA, digestB);
+}
+
+// Chunk size for an in-place swap whose journal must fit in slack bytes.
+// Block devices pass their logical block size so every request stays aligned.
+std::uint64_t inPlaceChunkSize(std::uint64_t slack, bool verify, std::uint64_t logicalBlock = 0) {
+    std::uint64_t alignment = logicalBlock ? std::lcm<std::uint64_t>(BUFFER_ALIGNMENT, logicalBlock) : BUFFER_ALIGNMENT;
+    std::uint64_t fitsSlack = slack > JOURNAL_HEADER_SIZE + 2 * JOURNAL_RECORD_META
+                                  ? (slack - JOURNAL_HEADER_SIZE - 2 * JOURNAL_RECORD_META) / 4
+                                  : 0;
+    std::uint64_t fitsMemory = sharedBufferPool().fairShare(MOVE_CHUNK_SIZE, verify ? 3 : 2);
+    std::uint64_t chunk = std::min(fitsSlack, fitsMemory) / alignment * alignment;
+    return std::max<std::uint64_t>(chunk, alignment);
+}
+
+// Journal of an in-place swap whose first (larger) operand is path. It sits
+// next to a regular file; a block device's goes in --journal-dir, named
+// after the device's stable identity, since /dev doesn't survive a reboot
+// and kernel names can change between boots.
+std::string journalPathFor(const std::string& path, const SwapOptions& options) {
+    if (!statPath(path).isBlockDevice) return path + JOURNAL_SUFFIX;
+    std::string name = blockDeviceIdentity(path);
+    std::replace(name.begin(), name.end(), '/', '_');
+    name.erase(0, name.find_first_not_of('_'));
+    return (options.journalDir / (name + JOURNAL_SUFFIX)).string();
+}
+
+// Larger of two logical block sizes (0 for regular files)
+std::uint64_t commonLogicalBlock(const FileStat& statA, const FileStat& statB) {
+    return std::max<std::uint64_t>(statA.logicalBlock, statB.logicalBlock);
+}
+
+// Peak extra space an in-place swap needs on each file's filesystem. The
+// smaller file grows by the size difference; the larger file's filesystem
+// holds the journal, whose records are written only after the tail move has
+// freed that difference there.
+void inPlaceSpaceNeeds(std::uint64_t sizeA, std::uint64_t sizeB, std::uint64_t chunk,
+                       std::uint64_t& needA, std::uint64_t& needB) {
+    std::uint64_t diff = sizeA > sizeB ? sizeA - sizeB : sizeB - sizeA;
+    std::uint64_t journal = JOURNAL_HEADER_SIZE + 2 * (JOURNAL_RECORD_META + 2 * chunk);
+    std::uint64_t journalPeak = std::max(JOURNAL_HEADER_SIZE, journal > diff ? journal - diff : 0);
+    needA = sizeA >= sizeB ? journalPeak : diff;
+    needB = sizeA >= sizeB ? diff : journalPeak;
+}
+
+// Crash journal for inPlaceSwap(), kept next to the larger file as
+// "<file>.xmv_journal". The header records the original sizes, the chunk size
+// and the other file's path (for a region swap, the region length and both
+// offsets; the journal then sits next to the first file), and for block
+// devices their stable identities and capacities. Two record slots follow; each exchange step
+// stores both files' original data for its range in the next slot before
+// overwriting them, so an interrupted step can be redone. Records carry a
+// sequence number and a SHA-256 digest, and the newest intact one wins.
+// Integers are in host byte order; a journal is only read on the machine that wrote it.
+class SwapJournal {
+public:
+    struct Header {
+        std::uint64_t sizeBig = 0;
+        std::uint64_t sizeSmall = 0;
+        std::uint64_t chunk = 0;
+        std::string smallPath;
+        bool region = false;            // Region swap: sizes are the region length
+        std::uint64_t offsetBig = 0;    // Where the exchanged ranges start in each file
+        std::uint64_t offsetSmall = 0;
+        std::string bigDevice;          // Block devices: stable identity and capacity,
+        std::string smallDevice;        // checked before resuming (empty/0 for files)
+        std::uint64_t bigDeviceSize = 0;
+        std::uint64_t smallDeviceSize = 0;
+    };
+
+    struct Record {
+        std::uint64_t sequence = 0;
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+    };
+
+    bool create(const std::string& path, const Header& header) {
+        if (header.smallPath.size() > DEVICE_FIELDS - 64 || header.bigDevice.size() > IDENTITY_MAX ||
+            header.smallDevice.size() > IDENTITY_MAX) {
+            return false;
+        }
+        if (!file_.open(path, RawFile::Mode::WRITE)) return false;
+        file_.close();
+        if (!file_.open(path, RawFile::Mode::READ_WRITE)) return false;
+
+        std::string block(static_cast<size_t>(JOURNAL_HEADER_SIZE), '\0');
+        std::memcpy(&block[0], MAGIC, sizeof(MAGIC));
+        putU64(block, 8, header.sizeBig);
+        putU64(block, 16, header.sizeSmall);
+        putU64(block, 24, header.chunk);
+        putU64(block, 32, header.smallPath.size());
+        putU64(block, 40, header.region ? 1 : 0);
+        putU64(block, 48, header.offsetBig);
+        putU64(block, 56, header.offsetSmall);
+        block.replace(64, header.smallPath.size(), header.smallPath);
+        putU64(block, DEVICE_FIELDS, header.bigDeviceSize);
+        putU64(block, DEVICE_FIELDS + 8, header.smallDeviceSize);
+        putU64(block, DEVICE_FIELDS + 16, header.bigDevice.size());
+        putU64(block, DEVICE_FIELDS + 24, header.smallDevice.size());
+        block.replace(DEVICE_FIELDS + 32, header.bigDevice.size(), header.bigDevice);
+        block.replace(DEVICE_FIELDS + 32 + IDENTITY_MAX, header.smallDevice.size(), header.smallDevice);
+
+        header_ = header;
+        return file_.writeAt(block.data(), static_cast<std::streamsize>(block.size()), 0) && file_.sync();
+    }
+
+    bool open(const std::string& path, Header& header) {
+        if (!file_.open(path, RawFile::Mode::READ_WRITE)) return false;
+        std::string block(static_cast<size_t>(JOURNAL_HEADER_SIZE), '\0');
+        if (file_.readAt(&block[0], static_cast<std::streamsize>(block.size()), 0) !=
+                static_cast<std::streamsize>(block.size()) ||
+            std::memcmp(block.data(), MAGIC, sizeof(MAGIC)) != 0) {
+            return false;
+        }
+        header.sizeBig = getU64(block, 8);
+        header.sizeSmall = getU64(block, 16);
+        header.chunk = getU64(block, 24);
+        std::uint64_t pathLength = getU64(block, 32);
+        header.region = getU64(block, 40) != 0;
+        header.offsetBig = getU64(block, 48);
+        header.offsetSmall = getU64(block, 56);
+        header.bigDeviceSize = getU64(block, DEVICE_FIELDS);
+        header.smallDeviceSize = getU64(block, DEVICE_FIELDS + 8);
+        std::uint64_t bigLength = getU64(block, DEVICE_FIELDS + 16);
+        std::uint64_t smallLength = getU64(block, DEVICE_FIELDS + 24);
+        if (header.chunk == 0 || header.sizeSmall > header.sizeBig || pathLength > DEVICE_FIELDS - 64 ||
+            bigLength > IDENTITY_MAX || smallLength > IDENTITY_MAX) {
+            return false;
+        }
+        header.smallPath = block.substr(64, static_cast<size_t>(pathLength));
+        header.bigDevice = block.substr(DEVICE_FIELDS + 32, static_cast<size_t>(bigLength));
+        header.smallDevice = block.substr(DEVICE_FIELDS + 32 + IDENTITY_MAX, static_cast<size_t>(smallLength));
+        header_ = header;
+        return true;
+    }
+
+    // Durably store one exchange step (slot alternates with the sequence number)
+    bool writeRecord(const Record& record, const char* bigData, const char* smallData) {
+        XMV_TRACE_SPAN("journal", record.offset);
+        std::string meta(static_cast<size_t>(JOURNAL_RECORD_META), '\0');
+        putU64(meta, 0, record.sequence);
+        putU64(meta, 8, record.offset);
+        putU64(meta, 16, record.length);
+        std::string digest = recordDigest(meta, bigData, smallData, record.length);
+        meta.replace(24, digest.size(), digest);
+
+        std::uint64_t slot = slotOffset(record.sequence);
+        std::streamsize length = static_cast<std::streamsize>(record.length);
+        return file_.writeAt(meta.data(), static_cast<std::streamsize>(meta.size()), slot) &&
+               file_.writeAt(bigData, length, slot + JOURNAL_RECORD_META) &&
+               file_.writeAt(smallData, length, slot + JOURNAL_RECORD_META + header_.chunk) &&
+               file_.sync();
+    }
+
+    // Load the newest intact record into the buffers; false if there is none
+    bool readLatest(Record& latest, char* bigData, char* smallData) {
+        bool found = false;
+        for (std::uint64_t slotIndex = 0; slotIndex < 2; ++slotIndex) {
+            std::uint64_t slot = slotOffset(slotIndex);
+            std::string meta(static_cast<size_t>(JOURNAL_RECORD_META), '\0');
+            if (file_.readAt(&meta[0], static_cast<std::streamsize>(meta.size()), slot) !=
+                static_cast<std::streamsize>(meta.size())) {
+                continue;
+            }
+            Record record;
+            record.sequence = getU64(meta, 0);
+            record.offset = getU64(meta, 8);
+            record.length = getU64(meta, 16);
+            if (record.sequence == 0 || record.length == 0 || record.length > header_.chunk ||
+                (found && record.sequence < latest.sequence)) {
+                continue;
+            }
+
+            std::vector<char> big(static_cast<size_t>(record.length));
+            std::vector<char> small(static_cast<size_t>(record.length));
+            std::streamsize length = static_cast<std::streamsize>(record.length);
+            if (file_.readAt(big.data(), length, slot + JOURNAL_RECORD_META) != length ||
+                file_.readAt(small.data(), length, slot + JOURNAL_RECORD_META + header_.chunk) != length) {
+                continue;
+            }
+            std::string stored = meta.substr(24, CryptoPP::SHA256::DIGESTSIZE);
+            std::fill(meta.begin() + 24, meta.end(), '\0');
+            if (recordDigest(meta, big.data(), small.data(), record.length) != stored) {
+                continue;  // Torn write; the other slot holds the previous step
+            }
+
+            std::copy(big.begin(), big.end(), bigData);
+            std::copy(small.begin(), small.end(), smallData);
+            latest = record;
+            found = true;
+        }
+        return found;
+    }
+
+    void close() { file_.close(); }
+
+private:
+    static constexpr char MAGIC[8] = {'X', 'M', 'V', 'J', 'R', 'N', 'L', '1'};
+    static constexpr size_t DEVICE_FIELDS = 2048;   // Block device sizes and identities start here
+    static constexpr size_t IDENTITY_MAX = 1000;
+
+    std::uint64_t slotOffset(std::uint64_t sequence) const {
+        return JOURNAL_HEADER_SIZE + (sequence % 2) * (JOURNAL_RECORD_META + 2 * header_.chunk);
+    }
+
+    static std::string recordDigest(const std::string& meta, const char* bigData, const char* smallData,
+                                    std::uint64_t length) {
+        CryptoPP::SHA256 hash;
+        hash.Update(reinterpret_cast<const CryptoPP::byte*>(meta.data()), meta.size());
+        hash.Update(reinterpret_cast<const CryptoPP::byte*>(bigData), static_cast<size_t>(length));
+        hash.Update(reinterpret_cast<const CryptoPP::byte*>(smallData), static_cast<size_t>(length));
+        std::string digest(CryptoPP::SHA256::DIGESTSIZE, 0);
+        hash.Final(reinterpret_cast<CryptoPP::byte*>(&digest[0]));
+        return digest;
+    }
+
+    static void putU64(std::string& block, size_t at, std::uint64_t value) {
+        std::memcpy(&block[at], &value, sizeof(value));
+    }
+    static std::uint64_t getU64(const std::string& block, size_t at) {
+        std::uint64_t value;
+        std::memcpy(&value, block.data() + at, sizeof(value));
+        return value;
+    }
+
+    RawFile file_;
+    Header header_;
+};
+
+constexpr char SwapJournal::MAGIC[8];
+constexpr size_t SwapJournal::DEVICE_FIELDS;
+constexpr size_t SwapJournal::IDENTITY_MAX;
+
+// Swap two files in place when there is no room for temporary copies.
+// 1. The larger file's tail (past the smaller file's size) moves into the
+//    smaller file from the end backwards, truncating the larger file after
+//    each chunk is synced, so the smaller file's device only ever grows by
+//    the size difference.
+// 2. The common prefix is exchanged chunk by chunk; each step is written to
+//    the journal first, then to both files.
+// Every write is synced (and read back with --verify) before anything it
+// replaces is dropped. If interrupted, rerunning the same swap resumes.
+// With --sparse, zero blocks are punched instead of written.
+// With --range-a/--range-b only step 2 runs, over the two regions; every
+// other byte of both files is left alone.
+bool inPlaceSwap(const std::string& fileA, const std::string& fileB,
+                 const FileStat& statA, const FileStat& statB, const SwapOptions& options, SparseWriter& writer) {
+    // An existing journal next to either file decides the roles
+    bool regions = options.regionA.length > 0;
+    bool aIsBig = regions || fs::exists(journalPathFor(fileA, options)) ||
+                  (!fs::exists(journalPathFor(fileB, options)) && statA.size >= statB.size);
+    const std::string& bigPath = aIsBig ? fileA : fileB;
+    const std::string& smallPath = aIsBig ? fileB : fileA;
+    std::string journalPath = journalPathFor(bigPath, options);
+    std::string smallAbsolute = fs::absolute(fs::path(smallPath)).string();
+
+    const FileStat& bigStat = aIsBig ? statA : statB;
+    const FileStat& smallStat = aIsBig ? statB : statA;
+    std::string bigDevice = bigStat.isBlockDevice ? blockDeviceIdentity(bigPath) : "";
+    std::string smallDevice = smallStat.isBlockDevice ? blockDeviceIdentity(smallPath) : "";
+
+    SwapJournal journal;
+    SwapJournal::Header header;
+    bool resuming = fs::exists(journalPath);
+    if (resuming) {
+        // A device is recognised by its identity, not by its /dev name
+        if (!journal.open(journalPath, header) || (smallDevice.empty() && header.smallPath != smallAbsolute) ||
+            header.region != regions ||
+            (regions && (header.sizeSmall != options.regionA.length || header.offsetBig != options.regionA.offset ||
+                         header.offsetSmall != options.regionB.offset))) {
+            std::cerr << "Error: " << journalPath << " belongs to a different swap." << std::endl;
+            return false;
+        }
+        if (header.bigDevice != bigDevice || header.smallDevice != smallDevice ||
+            header.bigDeviceSize != (bigStat.isBlockDevice ? bigStat.size : 0) ||
+            header.smallDeviceSize != (smallStat.isBlockDevice ? smallStat.size : 0)) {
+            std::cerr << "Error: " << journalPath << " was written for other devices (identity or size differs); "
+                      << "refusing to resume." << std::endl;
+            return false;
+        }
+        std::cout << "Resuming interrupted in-place swap." << std::endl;
+    } else {
+        header.sizeBig = regions ? options.regionA.length : aIsBig ? statA.size : statB.size;
+        header.sizeSmall = regions ? options.regionB.length : aIsBig ? statB.size : statA.size;
+        header.chunk = inPlaceChunkSize(options.slack, options.verify, commonLogicalBlock(statA, statB));
+        header.smallPath = smallAbsolute;
+        header.region = regions;
+        header.offsetBig = options.regionA.offset;
+        header.offsetSmall = options.regionB.offset;
+        header.bigDevice = bigDevice;
+        header.smallDevice = smallDevice;
+        header.bigDeviceSize = bigStat.isBlockDevice ? bigStat.size : 0;
+        header.smallDeviceSize = smallStat.isBlockDevice ? smallStat.size : 0;
+        if (!journal.create(journalPath, header)) {
+            std::cerr << "Error: Unable to create journal " << journalPath << std::endl;
+            journal.close();
+            fs::remove(journalPath);
+            return false;
+        }
+    }
+
+    const std::uint64_t chunk = header.chunk;
+    RawFile big(bigPath, RawFile::Mode::READ_WRITE);
+    RawFile small(smallPath, RawFile::Mode::READ_WRITE);
+    if (!big.isOpen() || !small.isOpen()) {
+        std::cerr << "Error: Unable to open files for swapping." << std::endl;
+        return false;
+    }
+
+    BufferPool& pool = sharedBufferPool();
+    BufferPool::Lease bigLease = pool.acquire(static_cast<size_t>(chunk));
+    BufferPool::Lease smallLease = pool.acquire(static_cast<size_t>(chunk));
+    BufferPool::Lease checkLease;
+    if (options.verify) {
+        checkLease = pool.acquire(static_cast<size_t>(chunk));
+    }
+    char* bigData = bigLease.data();
+    char* smallData = smallLease.data();
+
+    // Sync a write and, with --verify, read it back from the device
+    auto commit = [&](RawFile& file, const char* data, std::streamsize count, std::uint64_t offset) {
+        XMV_TRACE_SPAN("commit", offset);
+        if (!writer.writeAt(file, data, count, offset, true) || !file.sync()) return false;
+        if (!options.verify) return true;
+#if defined(POSIX_FADV_DONTNEED)
+        posix_fadvise(file.fd(), static_cast<off_t>(offset), static_cast<off_t>(count), POSIX_FADV_DONTNEED);
+#endif
+        return file.readAt(checkLease.data(), count, offset) == count &&
+               std::equal(data, data + count, checkLease.data());
+    };
+
+    ProgressBar* progressBar = nullptr;
+    if (options.progress) {
+        progressBar = new ProgressBar((header.sizeBig + chunk - 1) / chunk);
+    }
+
+    std::string failure;
+
+    // Phase 1: move the tail. The larger file's current size says how far it got.
+    // Regions have the same length, so there is no tail.
+    std::uint64_t remaining = regions ? header.sizeSmall : statPath(bigPath).size;
+    if (remaining < header.sizeSmall || remaining > header.sizeBig || (!regions && !small.truncate(header.sizeBig))) {
+        failure = "files do not match the journal";
+    }
+    while (failure.empty() && remaining > header.sizeSmall) {
+        std::uint64_t start = std::max(header.sizeSmall, (remaining - 1) / chunk * chunk);
+        std::streamsize count = static_cast<std::streamsize>(remaining - start);
+        XMV_TRACE_SPAN("move tail", start);
+        if (big.readAt(bigData, count, start) != count) {
+            failure = "read error";
+        } else if (!commit(small, bigData, count, start)) {
+            failure = "write error";
+        } else if (!big.truncate(start)) {
+            failure = "unable to truncate";
+        } else {
+            remaining = start;
+            if (progressBar)
+                ++(*progressBar);
+        }
+    }
+
+    // With --checksum-cache, tables that describe both files as they were
+    // before this swap let phase 2 skip steps whose chunks already match:
+    // they are neither read, written nor journaled
+    ChunkDigests tableBig;
+    ChunkDigests tableSmall;
+    bool skipIdentical = !resuming && !regions && bigDevice.empty() && smallDevice.empty() &&
+                         loadChunkDigests(bigPath, bigStat, options.checksums, tableBig) &&
+                         loadChunkDigests(smallPath, smallStat, options.checksums, tableSmall);
+    std::uint64_t skipped = 0;
+
+    // Phase 2: exchange the common prefix (or the regions), redoing the last
+    // journaled step first. Record offsets are relative to the region starts.
+    const std::uint64_t baseBig = header.offsetBig;
+    const std::uint64_t baseSmall = header.offsetSmall;
+    std::uint64_t offset = 0;
+    SwapJournal::Record record;
+    if (failure.empty() && journal.readLatest(record, bigData, smallData)) {
+        std::streamsize count = static_cast<std::streamsize>(record.length);
+        if (!commit(big, smallData, count, baseBig + record.offset) ||
+            !commit(small, bigData, count, baseSmall + record.offset)) {
+            failure = "write error";
+        }
+        offset = record.offset + record.length;
+    }
+    while (failure.empty() && offset < header.sizeSmall) {
+        std::streamsize count = static_cast<std::streamsize>(std::min(chunk, header.sizeSmall - offset));
+        if (skipIdentical && tableBig.sameRange(tableSmall, offset, static_cast<std::uint64_t>(count))) {
+            offset += static_cast<std::uint64_t>(count);
+            skipped += static_cast<std::uint64_t>(count);
+            if (progressBar)
+                ++(*progressBar);
+            continue;
+        }
+        record.sequence++;
+        record.offset = offset;
+        record.length = static_cast<std::uint64_t>(count);
+        XMV_TRACE_SPAN("exchange chunk", offset);
+        if (big.readAt(bigData, count, baseBig + offset) != count ||
+            small.readAt(smallData, count, baseSmall + offset) != count) {
+            failure = "read error";
+        } else if (!journal.writeRecord(record, bigData, smallData)) {
+            failure = "journal write error";
+        } else if (!commit(big, smallData, count, baseBig + offset) ||
+                   !commit(small, bigData, count, baseSmall + offset)) {
+            failure = "write error";
+        } else {
+            offset += static_cast<std::uint64_t>(count);
+            if (progressBar)
+                ++(*progressBar);
+        }
+    }
+
+    delete progressBar;
+    big.close();
+    small.close();
+    journal.close();
+
+    if (!failure.empty()) {
+        std::cerr << "Error: In-place swap interrupted (" << failure << "). Progress is recorded in "
+                  << journalPath << "; run the same swap again to resume." << std::endl;
+        return false;
+    }
+
+    fs::remove(journalPath);
+
+    // Each file now holds the other's old content, so the tables trade places
+    if (skipIdentical) {
+        if (options.verbose) {
+            std::cout << "Skipped " << skipped << " bytes of identical chunks (checksum cache)" << std::endl;
+        }
+        tableSmall.bindTo(statPath(bigPath));
+        tableBig.bindTo(statPath(smallPath));
+        if (!saveChunkDigests(bigPath, tableSmall, options.checksums) ||
+            !saveChunkDigests(smallPath, tableBig, options.checksums)) {
+            if (options.verbose) std::cout << "Warning: Unable to store the checksum cache." << std::endl;
+        }
+    }
+    return true;
+}
+
+// --simulate: run the swap engine between two in-memory files on a simulated
+// device and report the modelled time. The layout is chosen as for a real
+// swap; a device with a seek penalty counts as one shared spinning disk.
+// Both files and both outputs are held in memory.
+int simulateSwap(const xmvio::DeviceModel& model, std::uint64_t sizeA, std::uint64_t sizeB,
+                 const SwapOptions& options) {
+    xmvio::SimDevice device(model, std::max<std::uint64_t>(1, std::max(sizeA, sizeB)));
+
+    // Deterministic input content, so runs are repeatable and the result can be checked
+    auto fill = [&](const std::string& name, std::uint64_t size, std::uint32_t seed) {
+        std::unique_ptr<IoFile> file = device.open(name, IoFile::Mode::WRITE);
+        std::vector<char> block(static_cast<size_t>(std::min<std::uint64_t>(size, CHUNK_SIZE_SECURE)));
+        std::uint32_t state = seed;
+        for (std::uint64_t written = 0; written < size; written += block.size()) {
+            for (auto& c : block) {
+                state = state * 1664525u + 1013904223u;
+                c = static_cast<char>(state >> 24);
+            }
+            file->write(block.data(), static_cast<std::streamsize>(std::min<std::uint64_t>(block.size(), size - written)));
+        }
+    };
+    fill("a", sizeA, 1);
+    fill("b", sizeB, 2);
+    device.clearLog();
+
+    std::unique_ptr<IoFile> inA = device.open("a", IoFile::Mode::READ);
+    std::unique_ptr<IoFile> inB = device.open("b", IoFile::Mode::READ);
+    std::unique_ptr<IoFile> outA = device.open("a.temp", IoFile::Mode::WRITE);
+    std::unique_ptr<IoFile> outB = device.open("b.temp", IoFile::Mode::WRITE);
+
+    bool largeExtents = options.extents == ExtentMode::ON ||
+                        (options.extents == ExtentMode::AUTO && options.threads == 1 && model.seekPenalty > 0);
+    std::streamsize chunkSize = static_cast<std::streamsize>(
+        sharedBufferPool().fairShare(static_cast<size_t>(options.secure ? CHUNK_SIZE_SECURE : CHUNK_SIZE_FAST), 2));
+    EngineLayout layout = chooseEngineLayout(*inA, *inB, sizeA, sizeB, largeExtents, chunkSize, options);
+
+    SparseWriter writer(options.sparse);
+    if (!runSwapEngine(*inA, *inB, *outA, *outB, writer, sizeA, sizeB, layout, options, nullptr, nullptr, nullptr) ||
+        device.contents("a.temp") != device.contents("b") || device.contents("b.temp") != device.contents("a")) {
+        std::cerr << "Error: Simulated swap produced wrong data." << std::endl;
+        return 1;
+    }
+
+    xmvio::SimResult result = device.simulate();
+    double megabytes = static_cast<double>(sizeA + sizeB) / (1024.0 * 1024.0);
+
+    std::cout << "Simulated device: " << static_cast<std::uint64_t>(model.bandwidth) << " bytes/s, latency "
+              << model.latency * 1e6 << " us, queue depth " << model.queueDepth << ", seek "
+              << model.seekPenalty * 1e6 << " us" << std::endl;
+    std::cout << "Files: " << sizeA << " and " << sizeB << " bytes" << std::endl;
+    std::cout << "Engine: " << (layout.ranged() ? std::to_string(layout.workers) + " range worker(s)" : "sequential")
+              << ", " << layout.chunk << "-byte chunks" << std::endl;
+    std::cout << "Requests: " << result.reads << " reads, " << result.writes << " writes, "
+              << result.seeks << " seeks" << std::endl;
+    std::cout << "Simulated time: " << result.seconds << " s ("
+              << (result.seconds > 0 ? megabytes / result.seconds : 0.0) << " MB/s)" << std::endl;
+    return 0;
+}
+
+// Function to perform XOR swap of two files
+// statA/statB come from the caller's single stat of each file
+// Returns false (after printing the reason) if the swap was not completed
+bool xorSwap(const std::string& fileA, const std::string& fileB,
+             const FileStat& statA, const FileStat& statB, const SwapOptions& options) {
+    // fast mode optimization planned for v0.5.0 (issue #3)
+    (void)options.fast;
+
+    // Check if both files exist
+    if (!statA.exists || !statB.exists) {
+        std::cerr << "Error: One or both files do not exist." << std::endl;
+        return false;
+    }
+
+    // Open log file if specified
+    std::ofstream log;
+    if (!options.logFile.empty()) {
+        log.open(options.logFile, std::ios::app);
+        if (!log) {
+            std::cerr << "Error: Unable to open log file." << std::endl;
+            return false;
+        }
+    }
+
+    // Not enough room for temporary copies (or an interrupted one is pending)
+    if (options.inPlace) {
+        SparseWriter writer(options.sparse);
+        if (!inPlaceSwap(fileA, fileB, statA, statB, options, writer)) {
+            return false;
+        }
+        reportSparse(log, writer);
+        if (options.verify) {
+            logVerification(log, options.verbose, fileA, fileB, "read-back comparison of every chunk written");
+        }
+        if (options.verbose) {
+            std::string message = "Swap completed successfully (in place).";
+            std::cout << message << std::endl;
+            if (log)
+                log << message << std::endl;
+        }
+        return true;
+    }
+
+    // Small files: one read and one write per file, no chunk buffers or free-space query
+    if (statA.size <= SMALL_FILE_LIMIT && statB.size <= SMALL_FILE_LIMIT) {
+        if (!smallFileSwap(fileA, fileB, statA, statB, options)) {
+            return false;
+        }
+        if (options.verify) {
+            logVerification(log, options.verbose, fileA, fileB, "read-back comparison");
+        }
+        if (options.verbose) {
+            std::string message = "Swap completed successfully (small-file path).";
+            std::cout << message << std::endl;
+            if (log)
+                log << message << std::endl;
+        }
+        return true;
+    }
+
+    // Cached digest tables let identical pairs skip the swap and verification skip the sources
+    ChunkDigests digestsA;
+    ChunkDigests digestsB;
+    bool haveDigestsA = loadChunkDigests(fileA, statA, options.checksums, digestsA);
+    bool haveDigestsB = loadChunkDigests(fileB, statB, options.checksums, digestsB);
+    if (haveDigestsA && haveDigestsB && digestsA.sameContent(digestsB)) {
+        if (options.verbose) {
+            std::string message = "Files are identical (checksum cache); nothing to swap.";
+            std::cout << message << std::endl;
+            if (log)
+                log << message << std::endl;
+        }
+        return true;
+    }
+
+    // Check if there is enough space on the target drive
+    fs::path pathA(fileA);
+    fs::path pathB(fileB);
+    fs::space_info spaceB = fs::space(pathB.parent_path());
+    if (spaceB.available < statA.size) {
+        std::cerr << "Error: Insufficient space on the target drive." << std::endl;
+        return false;
+    }
+
+    // Calculate chunk size based on secure mode, limited so both buffers fit the memory budget
+    std::streamsize chunkSize = static_cast<std::streamsize>(
+        sharedBufferPool().fairShare(static_cast<size_t>(options.secure ? CHUNK_SIZE_SECURE : CHUNK_SIZE_FAST), 2));
+
+    // Open input and output files
+    RawFile inA(fileA, RawFile::Mode::READ);
+    RawFile inB(fileB, RawFile::Mode::READ);
+    RawFile outA(fileA + ".temp", RawFile::Mode::WRITE);
+    RawFile outB(fileB + ".temp", RawFile::Mode::WRITE);
+
+    if (!inA.isOpen() || !inB.isOpen() || !outA.isOpen() || !outB.isOpen()) {
+        std::cerr << "Error: Unable to open files for swapping." << std::endl;
+        outA.close();
+        outB.close();
+        fs::remove(fileA + ".temp");
+        fs::remove(fileB + ".temp");
+        return false;
+    }
+
+    std::uint64_t largest = std::max(statA.size, statB.size);
+    bool largeExtents = useLargeExtents(statA, statB, options.extents, options.threads);
+    EngineLayout layout = chooseEngineLayout(inA, inB, statA.size, statB.size, largeExtents, chunkSize, options);
+    chunkSize = static_cast<std::streamsize>(layout.chunk);
+
+    // Initialize progress bar if enabled
+    ProgressBar* progressBar = nullptr;
+    if (options.progress) {
+        // One tick per chunk of the larger file
+        std::uint64_t chunk = static_cast<std::uint64_t>(chunkSize);
+        progressBar = new ProgressBar((largest + chunk - 1) / chunk);
+    }
+
+    // The sequential loop digests inputs that have no cached table as it reads them
+    bool caching = options.checksums != ChecksumStore::OFF;
+    ChunkDigester digesterA;
+    ChunkDigester digesterB;
+    bool streamDigestsA = caching && !haveDigestsA && !layout.ranged();
+    bool streamDigestsB = caching && !haveDigestsB && !layout.ranged();
+
+    SparseWriter writer(options.sparse);
+    bool ioError = !runSwapEngine(inA, inB, outA, outB, writer, statA.size, statB.size, layout, options, progressBar,
+                                  streamDigestsA ? &digesterA : nullptr, streamDigestsB ? &digesterB : nullptr);
+    // The temp copies must be on disk before they replace the originals
+    if (!ioError && options.sync != SyncPolicy::NONE) {
+        XMV_TRACE_SPAN("fsync", 0);
+        ioError = !outA.sync() || !outB.sync();
+    }
+    if (!ioError && streamDigestsA) {
+        digestsA = digesterA.finish();
+        haveDigestsA = true;
+    }
+    if (!ioError && streamDigestsB) {
+        digestsB = digesterB.finish();
+        haveDigestsB = true;
+    }
+
+    delete progressBar;
+
+    // Close files
+    inA.close();
+    inB.close();
+    outA.close();
+    outB.close();
+
+    if (ioError) {
+        std::cerr << "Error: I/O failure during swap; original files are unchanged." << std::endl;
+        fs::remove(fileA + ".temp");
+        fs::remove(fileB + ".temp");
+        return false;
+    }
+
+    // With the checksum cache, verification compares per-chunk tables: the
+    // outputs are read once and the sources only when no table is cached.
+    // The output tables are what the cache stores for the swapped files.
+    ChunkDigests swappedA;   // fileA.temp, which holds B's content
+    ChunkDigests swappedB;
+    if (caching) {
+        if (options.verify) {
+            if ((!haveDigestsA && !computeChunkDigests(fileA, digestsA)) ||
+                (!haveDigestsB && !computeChunkDigests(fileB, digestsB)) ||
+                !computeChunkDigests(fileA + ".temp", swappedA) ||
+                !computeChunkDigests(fileB + ".temp", swappedB)) {
+                std::cerr << "Error: Unable to read files for verification." << std::endl;
+                fs::remove(fileA + ".temp");
+                fs::remove(fileB + ".temp");
+                return false;
+            }
+            size_t differing = swappedA.countDifferences(digestsB) + swappedB.countDifferences(digestsA);
+            if (differing > 0) {
+                std::cerr << "Error: File integrity check failed (" << differing
+                          << " chunk(s) differ)." << std::endl;
+                fs::remove(fileA + ".temp");
+                fs::remove(fileB + ".temp");
+                return false;
+            }
+            // The cache format fixes the chunk digest, whatever --verify=ALGO asked for
+            logVerification(log, options.verbose, fileA, fileB, "sha256 chunk digests (checksum cache)");
+        } else {
+            // Without verification, the outputs are trusted to hold the other
+            // input's content; tables the swap didn't get for free (range
+            // workers, no cached table) are not rebuilt by rereading
+            caching = haveDigestsA && haveDigestsB;
+            swappedA = digestsB;
+            swappedB = digestsA;
+        }
+    } else if (options.verify) {
+        std::string hashA = calculateChecksum(fileA + ".temp", options.verifyAlgorithm);
+        std::string hashB = calculateChecksum(fileB + ".temp", options.verifyAlgorithm);
+
+        if (hashA != calculateChecksum(fileB, options.verifyAlgorithm) ||
+            hashB != calculateChecksum(fileA, options.verifyAlgorithm)) {
+            std::cerr << "Error: File integrity check failed." << std::endl;
+            fs::remove(fileA + ".temp");
+            fs::remove(fileB + ".temp");
+            return false;
+        }
+        logVerification(log, options.verbose, fileA, fileB, verifyAlgorithmName(options.verifyAlgorithm));
+    }
+
+    // Replace original files with swapped files
+    // After XOR swap: fileA.temp has B's content, fileB.temp has A's content
+    // So we rename each temp back to its original filename to complete the swap
+    {
+        XMV_TRACE_SPAN("rename", 0);
+        fs::rename(fileA + ".temp", fileA);
+        fs::rename(fileB + ".temp", fileB);
+    }
+    if (!noteRename(options, fileA + ".temp", fileA) || !noteRename(options, fileB + ".temp", fileB)) {
+        std::cerr << "Error: Unable to flush the renames to disk." << std::endl;
+        return false;
+    }
+
+    reportSparse(log, writer);
+
+    // Record the new tables against the swapped files' own validators
+    if (caching) {
+        swappedA.bindTo(statPath(pathA));
+        swappedB.bindTo(statPath(pathB));
+        bool savedA = saveChunkDigests(fileA, swappedA, options.checksums);
+        bool savedB = saveChunkDigests(fileB, swappedB, options.checksums);
+        if (options.verbose && (!savedA || !savedB)) {
+            std::cout << "Warning: Unable to store the checksum cache." << std::endl;
+        }
+    }
+
+    // Log success message if verbose mode is enabled
+    if (options.verbose) {
+        std::string message = "XOR swap completed successfully.";
+        std::cout << message << std::endl;
+        if (log)
+            log << message << std::endl;
+    }
+
+    return true;
+}
+
+// ============================================================
+// Minimal JSON support for plan files
+// ============================================================
+
+// Escape a string for inclusion in JSON output
+std::string jsonEscape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    for (char c : text) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+// Parsed JSON value. Numbers keep their source text so 64-bit sizes round-trip exactly.
+struct JsonValue {
+    enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = Type::NUL;
+    bool boolean = false;
+    std::string text;                              // STRING contents or NUMBER source text
+    std::vector<JsonValue> items;                  // ARRAY
+    std::vector<std::pair<std::string, JsonValue>> members;  // OBJECT, in file order
+
+    const JsonValue* find(const std::string& key) const {
+        for (const auto& member : members) {
+            if (member.first == key) return &member.second;
+        }
+        return nullptr;
+    }
+
+    // Typed accessors for required members; throw if missing or mistyped
+    const JsonValue& at(const std::string& key) const {
+        const JsonValue* value = find(key);
+        if (!value) throw std::runtime_error("missing \"" + key + "\"");
+        return *value;
+    }
+    std::string asString() const {
+        if (type != Type::STRING) throw std::runtime_error("expected a string");
+        return text;
+    }
+    bool asBool() const {
+        if (type != Type::BOOL) throw std::runtime_error("expected true or false");
+        return boolean;
+    }
+    std::int64_t asInt() const {
+        if (type != Type::NUMBER) throw std::runtime_error("expected a number");
+        return std::stoll(text);
+    }
+    std::uint64_t asUInt() const {
+        if (type != Type::NUMBER || (!text.empty() && text[0] == '-')) throw std::runtime_error("expected a size");
+        return std::stoull(text);
+    }
+};
+
+// Recursive-descent parser for the JSON subset xmv writes (no \u escapes beyond ASCII)
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& input) : in_(input) {}
+
+    JsonValue parse() {
+        JsonValue value = parseValue();
+        skipSpace();
+        if (pos_ != in_.size()) fail("trailing characters");
+        return value;
+    }
+
+private:
+    JsonValue parseValue() {
+        skipSpace();
+        if (pos_ >= in_.size()) fail("unexpected end of input");
+
+        JsonValue value;
+        char c = in_[pos_];
+        if (c == '{') {
+            value.type = JsonValue::Type::OBJECT;
+            ++pos_;
+            skipSpace();
+            if (peek() == '}') { ++pos_; return value; }
+            while (true) {
+                skipSpace();
+                std::string key = parseString();
+                skipSpace();
+                expect(':');
+                value.members.emplace_back(key, parseValue());
+                skipSpace();
+                if (peek() == ',') { ++pos_; continue; }
+                expect('}');
+                return value;
+            }
+        }
+        if (c == '[') {
+            value.type = JsonValue::Type::ARRAY;
+            ++pos_;
+            skipSpace();
+            if (peek() == ']') { ++pos_; return value; }
+            while (true) {
+                value.items.push_back(parseValue());
+                skipSpace();
+                if (peek() == ',') { ++pos_; continue; }
+                expect(']');
+                return value;
+            }
+        }
+        if (c == '"') {
+            value.type = JsonValue::Type::STRING;
+            value.text = parseString();
+            return value;
+        }
+        if (in_.compare(pos_, 4, "true") == 0) {
+            pos_ += 4;
+            value.type = JsonValue::Type::BOOL;
+            value.boolean = true;
+            return value;
+        }
+        if (in_.compare(pos_, 5, "false") == 0) {
+            pos_ += 5;
+            value.type = JsonValue::Type::BOOL;
+            return value;
+        }
+        if (in_.compare(pos_, 4, "null") == 0) {
+            pos_ += 4;
+            return value;
+        }
+        if (c == '-' || std::isdigit(static_cast<unsigned char>(c))) {
+            size_t start = pos_++;
+            while (pos_ < in_.size() && (std::isdigit(static_cast<unsigned char>(in_[pos_])) ||
+                                         in_[pos_] == '.' || in_[pos_] == 'e' || in_[pos_] == 'E' ||
+                                         in_[pos_] == '+' || in_[pos_] == '-')) {
+                ++pos_;
+            }
+            value.type = JsonValue::Type::NUMBER;
+            value.text = in_.substr(start, pos_ - start);
+            return value;
+        }
+        fail("unexpected character");
+        return value;
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string out;
+        while (pos_ < in_.size() && in_[pos_] != '"') {
+            char c = in_[pos_++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= in_.size()) break;
+            char esc = in_[pos_++];
+            switch (esc) {
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    if (pos_ + 4 > in_.size()) fail("bad \\u escape");
+                    out += static_cast<char>(std::stoi(in_.substr(pos_, 4), nullptr, 16));
+                    pos_ += 4;
+                    break;
+                }
+                default: out += esc; break;
+            }
+        }
+        expect('"');
+        return out;
+    }
+
+    void skipSpace() {
+        while (pos_ < in_.size() && std::isspace(static_cast<unsigned char>(in_[pos_]))) ++pos_;
+    }
+    char peek() const { return pos_ < in_.size() ? in_[pos_] : '\0'; }
+    void expect(char c) {
+        if (peek() != c) fail(std::string("expected '") + c + "'");
+        ++pos_;
+    }
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("JSON parse error at offset " + std::to_string(pos_) + ": " + what);
+    }
+
+    const std::string& in_;
+    size_t pos_ = 0;
+};
+
+// ============================================================
+// Swap plans
+// ============================================================
+
+const int SWAP_PLAN_FORMAT = 1;
+
+// How a planned swap will be carried out
+enum class SwapMethod {
+    RENAME,     // Same filesystem: exchange names, then move to destinations
+    XOR         // Stream data through xorSwap(), then move to destinations
+};
+
+// One side of a planned swap
+struct PlannedFile {
+    fs::path source;
+    fs::path destination;
+    FileStat stat;                  // Source metadata when the plan was built
+    bool createDir = false;         // destination.parent_path() must be created
+    bool overwrite = false;         // destination exists and is not one of the sources
+    std::uint64_t spaceNeeded = 0;  // Extra bytes needed on this file's filesystem during the swap
+    std::uint64_t spaceAvailable = 0;
+    FileRegion region;              // Range to exchange (--range-a/--range-b); length 0 for the whole file
+};
+
+// Everything main() needs to execute a swap, built in one pass over the filesystem
+// so dry-run, prompts and execution don't repeat stat calls. Serializable with
+// --plan-out and executable later with --plan-in.
+struct SwapPlan {
+    PlannedFile file1;
+    PlannedFile file2;
+    SwapMethod method = SwapMethod::XOR;
+    bool sameFilesystem = false;
+    bool pathsChanging = false;
+    bool inPlace = false;           // XOR path swaps in place with a journal instead of temp copies
+
+    bool regionSwap() const { return file1.region.length > 0; }
+
+    std::string strategyName() const {
+        if (method == SwapMethod::RENAME) {
+            return pathsChanging ? "Rename exchange with path change (same filesystem)"
+                                 : "Rename exchange (atomic, same filesystem)";
+        }
+        if (regionSwap() && (file1.stat.isBlockDevice || file2.stat.isBlockDevice)) {
+            return "In-place journaled block device swap";
+        }
+        if (regionSwap()) {
+            return sameFilesystem ? "In-place journaled region swap (same filesystem)"
+                                  : "In-place journaled region swap (cross-drive)";
+        }
+        if (inPlace) {
+            return sameFilesystem ? "In-place journaled swap (same filesystem)" : "In-place journaled swap (cross-drive)";
+        }
+        return sameFilesystem ? "XOR swap (same filesystem)" : "XOR swap (cross-drive)";
+    }
+};
+
+// Checks for a swap involving block devices, made when planning and again
+// before a stored plan runs: sizes readable, devices unused, a --journal-dir
+// to keep the journal in, and ranges aligned to the logical block size.
+// Throws std::runtime_error.
+void checkDeviceSwap(const PlannedFile& file1, const PlannedFile& file2, const FileRegion& regionA,
+                     const FileRegion& regionB, const SwapOptions& options) {
+    for (const PlannedFile* file : {&file1, &file2}) {
+        if (file->stat.isBlockDevice && file->stat.size == 0) {
+            throw std::runtime_error("Unable to read the size of block device " + file->source.string() + ".");
+        }
+        if (file->stat.isBlockDevice && !blockDeviceUnused(file->source)) {
+            throw std::runtime_error(file->source.string() + " is in use (mounted or held by another device).");
+        }
+    }
+    if (options.sparse) {
+        throw std::runtime_error("--sparse can't be used with block devices.");
+    }
+    // The journal must be found again by a rerun from anywhere, so there is no default
+    if (options.journalDir.empty()) {
+        throw std::runtime_error("Swapping block devices needs --journal-dir, where the journal that makes an "
+                                 "interrupted swap resumable is kept.");
+    }
+    if (!fs::is_directory(options.journalDir)) {
+        throw std::runtime_error("--journal-dir " + options.journalDir.string() + " is not a directory.");
+    }
+    std::uint64_t block = commonLogicalBlock(file1.stat, file2.stat);
+    if (regionA.offset % block || regionB.offset % block || regionA.length % block) {
+        throw std::runtime_error("Ranges on block devices must be multiples of the " + std::to_string(block) +
+                                 "-byte logical block size.");
+    }
+}
+
+// Resolve destinations, pick the swap method and record required actions.
+// strategy is the --strategy value (AUTO, EXCHANGE, XOR or INPLACE, upper case).
+// Throws std::runtime_error if the swap can't be planned.
+SwapPlan buildSwapPlan(const fs::path& pathA, const fs::path& pathB,
+                       const std::string& dest1Str, const std::string& dest2Str,
+                       const std::string& strategy, const SwapOptions& options) {
+    SwapPlan plan;
+    plan.file1.source = pathA;
+    plan.file2.source = pathB;
+
+    // Stat each source once; existence, sizes and devices are reused below
+    plan.file1.stat = statPath(pathA);
+    plan.file2.stat = statPath(pathB);
+
+    // Check if source files exist
+    if (!plan.file1.stat.exists || !plan.file2.stat.exists) {
+        std::string message = "One or both files do not exist.";
+        if (!plan.file1.stat.exists) message += "\n  Missing: " + pathA.string();
+        if (!plan.file2.stat.exists) message += "\n  Missing: " + pathB.string();
+        throw std::runtime_error(message);
+    }
+
+    // Check if source files are on different drives
+#ifndef _WIN32
+    bool crossDrive = plan.file1.stat.device != plan.file2.stat.device;
+#else
+    bool crossDrive = !isSameFilesystem(pathA, pathB);
+#endif
+
+    // Block devices can't be truncated, renamed or copied aside: the whole
+    // device (or the given ranges) is exchanged in place
+    bool devices = plan.file1.stat.isBlockDevice || plan.file2.stat.isBlockDevice;
+    FileRegion regionA = options.regionA;
+    FileRegion regionB = options.regionB;
+    if (devices) {
+        if (!dest1Str.empty() || !dest2Str.empty()) {
+            throw std::runtime_error("Block devices are swapped in place; --1-to and --2-to don't apply.");
+        }
+        if (regionA.length == 0) {
+            if (plan.file1.stat.size != plan.file2.stat.size) {
+                throw std::runtime_error("A block device can only be swapped with an operand of the same size (" +
+                                         std::to_string(plan.file1.stat.size) + " vs " +
+                                         std::to_string(plan.file2.stat.size) +
+                                         " bytes); use --range-a/--range-b to swap part of one.");
+            }
+            regionA.length = regionB.length = plan.file1.stat.size;
+        }
+        checkDeviceSwap(plan.file1, plan.file2, regionA, regionB, options);
+    }
+
+    // --range-a/--range-b: exchange two equal-length regions in place; nothing is renamed
+    if (regionA.length > 0) {
+        if (regionA.length != regionB.length) {
+            throw std::runtime_error("--range-a and --range-b must have the same length.");
+        }
+        for (const PlannedFile* file : {&plan.file1, &plan.file2}) {
+            const FileRegion& region = file == &plan.file1 ? regionA : regionB;
+            if (region.offset > file->stat.size || region.length > file->stat.size - region.offset) {
+                throw std::runtime_error("Range " + std::to_string(region.offset) + ":" +
+                                         std::to_string(region.length) + " lies past the end of " +
+                                         file->source.string() + " (" + std::to_string(file->stat.size) +
+                                         " bytes).");
+            }
+        }
+        bool sameFile = !crossDrive && plan.file1.stat.inode != 0 && plan.file1.stat.inode == plan.file2.stat.inode;
+        if ((sameFile || pathA == pathB) && regionA.offset < regionB.offset + regionB.length &&
+            regionB.offset < regionA.offset + regionA.length) {
+            throw std::runtime_error("The two ranges overlap in the same file.");
+        }
+        if (strategy == "EXCHANGE") {
+            throw std::runtime_error("--strategy exchange swaps whole files; it can't be used with ranges.");
+        }
+        if (fs::exists(journalPathFor(pathB.string(), options)) && !fs::exists(journalPathFor(pathA.string(), options))) {
+            throw std::runtime_error("An interrupted in-place swap of these files must be resumed first.");
+        }
+
+        plan.file1.destination = pathA;
+        plan.file2.destination = pathB;
+        plan.file1.region = regionA;
+        plan.file2.region = regionB;
+        plan.sameFilesystem = !crossDrive;
+        plan.method = SwapMethod::XOR;
+        plan.inPlace = true;
+
+        // Only file 1's journal takes space (for a device, in --journal-dir)
+        std::uint64_t chunk =
+            inPlaceChunkSize(options.slack, options.verify, commonLogicalBlock(plan.file1.stat, plan.file2.stat));
+        plan.file1.spaceNeeded = JOURNAL_HEADER_SIZE + 2 * (JOURNAL_RECORD_META + 2 * chunk);
+        boost::system::error_code ec;
+        plan.file1.spaceAvailable = fs::space(fs::path(journalPathFor(pathA.string(), options)).parent_path(), ec).available;
+        plan.file2.spaceAvailable = crossDrive ? fs::space(pathB.parent_path(), ec).available
+                                               : plan.file1.spaceAvailable;
+        return plan;
+    }
+
+    // Determine default strategy:
+    // - Cross-drive: default to REL (move files to other drive with same relative path)
+    // - Same-drive: default to SAME (swap contents in place)
+    PathStrategy defaultStrategy = crossDrive ? PathStrategy::REL : PathStrategy::SAME;
+
+    // Parse destination specs
+    DestinationSpec dest1, dest2;
+    if (dest1Str.empty()) {
+        dest1.strategy = defaultStrategy;
+    } else {
+        dest1 = parseDestination(dest1Str, 1);
+    }
+    if (dest2Str.empty()) {
+        dest2.strategy = defaultStrategy;
+    } else {
+        dest2 = parseDestination(dest2Str, 2);
+    }
+
+    // Resolve destination paths (for SAME-AS-n the "other" file is passed second)
+    fs::path destA = resolveDestination(pathA, pathB, dest1, 1);
+    fs::path destB = resolveDestination(pathB, pathA, dest2, 2);
+    plan.file1.destination = destA;
+    plan.file2.destination = destB;
+
+    // Determine operation strategy
+    // Renames only work when sources and destinations all share one filesystem
+    bool sameDrive = !crossDrive && isSameFilesystem(destA, destB) && isSameFilesystem(pathA, destA);
+    plan.sameFilesystem = sameDrive;
+    plan.pathsChanging = (destA != pathA) || (destB != pathB);
+
+    if (strategy != "AUTO" && strategy != "EXCHANGE" && strategy != "XOR" && strategy != "INPLACE") {
+        throw std::runtime_error("Unknown strategy: " + strategy + " (expected auto, exchange, xor or inplace)");
+    }
+    if (strategy == "EXCHANGE" && !sameDrive) {
+        throw std::runtime_error("--strategy exchange needs both files on the same filesystem.");
+    }
+
+    // An interrupted in-place swap must be finished in place, whatever else applies
+    bool journalPending = fs::exists(journalPathFor(pathA.string(), options)) ||
+                          fs::exists(journalPathFor(pathB.string(), options));
+    if (journalPending && strategy == "EXCHANGE") {
+        throw std::runtime_error("An interrupted in-place swap of these files must be resumed first.");
+    }
+
+    // --strategy xor/inplace stream the data even when a rename would do (e.g. for benchmarking)
+    bool streamData = strategy == "XOR" || strategy == "INPLACE" || journalPending;
+    plan.method = (sameDrive && !streamData) ? SwapMethod::RENAME : SwapMethod::XOR;
+
+    // Directories to create and files that would be overwritten
+    for (PlannedFile* file : {&plan.file1, &plan.file2}) {
+        if (file->destination == pathA || file->destination == pathB) continue;
+        FileStat destDir = statPath(file->destination.parent_path());
+        file->createDir = !destDir.exists;
+        file->overwrite = !file->createDir && statPath(file->destination).exists;
+    }
+
+    // Space needs: the XOR path writes each file's new content next to the old one
+    // (small files too: their swapped contents are written to .temp copies first)
+    if (plan.method == SwapMethod::XOR) {
+        std::uint64_t sizeA = plan.file1.stat.size;
+        std::uint64_t sizeB = plan.file2.stat.size;
+        plan.file1.spaceNeeded = sizeB;
+        plan.file2.spaceNeeded = sizeA;
+
+        boost::system::error_code ec;
+        plan.file1.spaceAvailable = fs::space(pathA.parent_path(), ec).available;
+        plan.file2.spaceAvailable = crossDrive ? fs::space(pathB.parent_path(), ec).available
+                                               : plan.file1.spaceAvailable;
+
+        // Temp copies that don't fit fall back to an in-place swap, which only
+        // needs the size difference plus a journal bounded by --slack
+        bool tempsFit = crossDrive ? plan.file1.spaceNeeded <= plan.file1.spaceAvailable &&
+                                         plan.file2.spaceNeeded <= plan.file2.spaceAvailable
+                                   : plan.file1.spaceNeeded + plan.file2.spaceNeeded <= plan.file1.spaceAvailable;
+        plan.inPlace = journalPending || strategy == "INPLACE" || !tempsFit;
+        if (plan.inPlace) {
+            inPlaceSpaceNeeds(sizeA, sizeB, inPlaceChunkSize(options.slack, options.verify),
+                              plan.file1.spaceNeeded, plan.file2.spaceNeeded);
+        }
+    }
+
+    return plan;
+}
+
+// Print the dry-run report for a plan
+void printSwapPlan(const SwapPlan& plan, const SwapOptions& options) {
+    const PlannedFile& f1 = plan.file1;
+    const PlannedFile& f2 = plan.file2;
+
+    std::cout << "Dry run - no changes will be made\n" << std::endl;
+
+    std::cout << "Source files:" << std::endl;
+    for (const PlannedFile* file : {&f1, &f2}) {
+        std::cout << "  File " << (file == &f1 ? 1 : 2) << ": " << file->source.string() << " (" << file->stat.size
+                  << " bytes";
+        if (file->stat.isBlockDevice) {
+            std::cout << ", block device, " << file->stat.logicalBlock << "-byte logical blocks";
+        }
+        std::cout << ")" << std::endl;
+    }
+    if (plan.inPlace && (f1.stat.isBlockDevice || f2.stat.isBlockDevice)) {
+        std::cout << "  Journal: " << journalPathFor(f1.source.string(), options) << std::endl;
+    }
+    std::cout << std::endl;
+
+    if (plan.regionSwap()) {
+        std::cout << "Regions exchanged (" << f1.region.length << " bytes; everything else unchanged):" << std::endl;
+        std::cout << "  File 1: offset " << f1.region.offset << std::endl;
+        std::cout << "  File 2: offset " << f2.region.offset << std::endl;
+        std::cout << std::endl;
+    }
+
+    std::cout << "Destinations:" << std::endl;
+    std::cout << "  File 1 -> " << f1.destination.string();
+    if (f1.destination == f1.source) {
+        std::cout << " (unchanged)";
+    }
+    std::cout << std::endl;
+    std::cout << "  File 2 -> " << f2.destination.string();
+    if (f2.destination == f2.source) {
+        std::cout << " (unchanged)";
+    }
+    std::cout << std::endl;
+    std::cout << std::endl;
+
+    if (f1.createDir || f2.createDir || f1.overwrite || f2.overwrite) {
+        std::cout << "Actions required:" << std::endl;
+        for (const PlannedFile* file : {&f1, &f2}) {
+            if (file->createDir) {
+                std::cout << "  - Create directory: " << file->destination.parent_path().string()
+                          << " (--yes mkdir)" << std::endl;
+            }
+        }
+        for (const PlannedFile* file : {&f1, &f2}) {
+            if (file->overwrite) {
+                std::cout << "  - Overwrite existing: " << file->destination.string()
+                          << " (--yes overwrite)" << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    if (plan.method == SwapMethod::XOR) {
+        std::cout << (plan.inPlace ? "Peak extra space (in place, slack " + std::to_string(options.slack) + " bytes):"
+                                   : std::string("Space needed:"))
+                  << std::endl;
+        std::cout << "  File 1 filesystem: " << f1.spaceNeeded << " bytes (" << f1.spaceAvailable
+                  << " available)" << std::endl;
+        std::cout << "  File 2 filesystem: " << f2.spaceNeeded << " bytes (" << f2.spaceAvailable
+                  << " available)" << std::endl;
+        std::cout << std::endl;
+    }
+
+    std::cout << "Strategy: " << plan.strategyName() << std::endl;
+    std::cout << "Chunk size: " << (options.secure ? "1 MB (secure)" : "4 KB (fast)") << std::endl;
+    std::cout << "Verification: "
+              << (options.verify ? "Enabled (" + verifyAlgorithmName(options.verifyAlgorithm) + ")" : "Disabled")
+              << std::endl;
+    std::cout << "Cache policy: " << (options.cache.streaming() ? "stream" : "normal") << std::endl;
+    std::cout << "Sync: "
+              << (options.sync == SyncPolicy::NONE ? "none" : options.sync == SyncPolicy::END ? "end" : "paranoid")
+              << std::endl;
+    std::cout << "Memory budget: " << sharedBufferPool().budget() << " bytes" << std::endl;
+    if (options.threads > 1) {
+        std::cout << "Range workers: up to " << options.threads << std::endl;
+    }
+    if (options.sparse && plan.method == SwapMethod::XOR) {
+        std::cout << "Zero blocks: left as holes (" << SPARSE_BLOCK_SIZE << "-byte blocks)" << std::endl;
+    }
+    if (plan.method == SwapMethod::XOR && !plan.inPlace &&
+        useLargeExtents(f1.stat, f2.stat, options.extents, options.threads)) {
+        std::cout << "I/O pattern: large extents (up to " << LARGE_EXTENT_SIZE / (1024 * 1024)
+                  << " MB per file per step)" << std::endl;
+    }
+    if (plan.method == SwapMethod::XOR && !plan.inPlace && options.physicalOrder) {
+        std::cout << "I/O order: physical (FIEMAP)" << std::endl;
+    }
+
+    // Data swaps read every byte, so scattered extents decide whether they stream or seek
+    if (plan.method == SwapMethod::XOR) {
+        std::cout << std::endl;
+        std::cout << "Fragmentation:" << std::endl;
+        int fileNum = 1;
+        for (const PlannedFile* file : {&f1, &f2}) {
+            std::cout << "  File " << fileNum++ << ": ";
+            RawFile in(file->source.string(), RawFile::Mode::READ);
+            ExtentMap map = in.isOpen() ? readExtentMap(in, file->stat.size) : ExtentMap();
+            if (!map.known) {
+                std::cout << "layout not reported by the filesystem" << std::endl;
+                continue;
+            }
+            std::uint64_t runs = map.runs();
+            std::cout << map.extents.size() << " extents in " << runs << " contiguous runs";
+            if (runs > 0) {
+                std::uint64_t averageRun = map.mappedBytes() / runs;
+                std::cout << " (average run " << averageRun << " bytes)";
+                if (averageRun < SEEK_BOUND_RUN && runs > 1) {
+                    std::cout << " - likely seek-bound";
+                }
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+// Write a plan as JSON (--plan-out)
+void writeSwapPlan(const SwapPlan& plan, std::ostream& out) {
+    auto writeFile = [&](const PlannedFile& file) {
+        out << "    {\n"
+            << "      \"source\": \"" << jsonEscape(file.source.string()) << "\",\n"
+            << "      \"destination\": \"" << jsonEscape(file.destination.string()) << "\",\n"
+            << "      \"size\": " << file.stat.size << ",\n"
+            << "      \"mtime_ns\": " << file.stat.mtimeNs << ",\n"
+            << "      \"device\": " << file.stat.device << ",\n"
+            << "      \"block_device\": " << (file.stat.isBlockDevice ? "true" : "false") << ",\n"
+            << "      \"logical_block\": " << file.stat.logicalBlock << ",\n"
+            << "      \"create_dir\": " << (file.createDir ? "true" : "false") << ",\n"
+            << "      \"overwrite\": " << (file.overwrite ? "true" : "false") << ",\n"
+            << "      \"space_needed\": " << file.spaceNeeded << ",\n"
+            << "      \"space_available\": " << file.spaceAvailable;
+        if (file.region.length > 0) {
+            out << ",\n"
+                << "      \"range_offset\": " << file.region.offset << ",\n"
+                << "      \"range_length\": " << file.region.length;
+        }
+        out << "\n    }";
+    };
+
+    out << "{\n"
+        << "  \"xmv_plan\": " << SWAP_PLAN_FORMAT << ",\n"
+        << "  \"version\": \"" << XORMOVE_VERSION_STRING << "\",\n"
+        << "  \"method\": \"" << (plan.method == SwapMethod::RENAME ? "rename" : "xor") << "\",\n"
+        << "  \"same_filesystem\": " << (plan.sameFilesystem ? "true" : "false") << ",\n"
+        << "  \"paths_changing\": " << (plan.pathsChanging ? "true" : "false") << ",\n"
+        << "  \"in_place\": " << (plan.inPlace ? "true" : "false") << ",\n"
+        << "  \"files\": [\n";
+    writeFile(plan.file1);
+    out << ",\n";
+    writeFile(plan.file2);
+    out << "\n  ]\n}\n";
+}
+
+// Read a plan written by writeSwapPlan() (--plan-in)
+SwapPlan readSwapPlan(const std::string& planFile) {
+    std::ifstream in(planFile, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Unable to open plan file: " + planFile);
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string content = ss.str();
+
+    try {
+        JsonValue root = JsonParser(content).parse();
+        if (root.at("xmv_plan").asInt() != SWAP_PLAN_FORMAT) {
+            throw std::runtime_error("unsupported plan format");
+        }
+
+        SwapPlan plan;
+        std::string method = root.at("method").asString();
+        if (method == "rename") plan.method = SwapMethod::RENAME;
+        else if (method == "xor") plan.method = SwapMethod::XOR;
+        else throw std::runtime_error("unknown method \"" + method + "\"");
+        plan.sameFilesystem = root.at("same_filesystem").asBool();
+        plan.pathsChanging = root.at("paths_changing").asBool();
+        const JsonValue* inPlace = root.find("in_place");  // Absent in plans from older builds
+        plan.inPlace = inPlace && inPlace->asBool();
+
+        const JsonValue& files = root.at("files");
+        if (files.type != JsonValue::Type::ARRAY || files.items.size() != 2) {
+            throw std::runtime_error("\"files\" must list exactly two files");
+        }
+        PlannedFile* targets[] = {&plan.file1, &plan.file2};
+        for (size_t i = 0; i < 2; ++i) {
+            const JsonValue& item = files.items[i];
+            PlannedFile& file = *targets[i];
+            file.source = item.at("source").asString();
+            file.destination = item.at("destination").asString();
+            file.stat.exists = true;
+            file.stat.size = item.at("size").asUInt();
+            file.stat.mtimeNs = item.at("mtime_ns").asInt();
+            file.stat.device = item.at("device").asUInt();
+            const JsonValue* blockDevice = item.find("block_device");  // Absent in plans from older builds
+            file.stat.isBlockDevice = blockDevice && blockDevice->asBool();
+            const JsonValue* logicalBlock = item.find("logical_block");
+            file.stat.logicalBlock = logicalBlock ? static_cast<std::uint32_t>(logicalBlock->asUInt()) : 0;
+            file.createDir = item.at("create_dir").asBool();
+            file.overwrite = item.at("overwrite").asBool();
+            file.spaceNeeded = item.at("space_needed").asUInt();
+            file.spaceAvailable = item.at("space_available").asUInt();
+            if (const JsonValue* length = item.find("range_length")) {
+                file.region.offset = item.at("range_offset").asUInt();
+                file.region.length = length->asUInt();
+            }
+        }
+        if (plan.file1.region.length != plan.file2.region.length || (plan.regionSwap() && !plan.inPlace)) {
+            throw std::runtime_error("ranges must be given for both files, with the same length");
+        }
+        return plan;
+    } catch (const std::exception& err) {
+        throw std::runtime_error("Invalid plan file " + planFile + ": " + err.what());
+    }
+}
+
+// Check that the sources still match the plan (one stat each) and that no new
+// file appeared at a destination the plan did not expect to overwrite. The
+// fresh stats replace the stored ones, and block devices get the same checks
+// as when planning.
+void validateSwapPlan(SwapPlan& plan, const SwapOptions& options) {
+    std::string problems;
+    for (PlannedFile* file : {&plan.file1, &plan.file2}) {
+        FileStat now = statPath(file->source);
+        if (!now.exists) {
+            problems += "\n  Missing: " + file->source.string();
+        } else if (now.size != file->stat.size || now.mtimeNs != file->stat.mtimeNs ||
+                   now.device != file->stat.device || now.isBlockDevice != file->stat.isBlockDevice ||
+                   now.logicalBlock != file->stat.logicalBlock) {
+            problems += "\n  Changed since planning: " + file->source.string();
+        }
+        file->stat = now;
+
+        bool isSource = file->destination == plan.file1.source || file->destination == plan.file2.source;
+        if (!isSource && !file->overwrite && !file->createDir && statPath(file->destination).exists) {
+            problems += "\n  Destination now exists: " + file->destination.string();
+        }
+    }
+    if (!problems.empty()) {
+        throw std::runtime_error("Plan is out of date; re-run with --dry-run --plan-out." + problems);
+    }
+    if (plan.file1.stat.isBlockDevice || plan.file2.stat.isBlockDevice) {
+        checkDeviceSwap(plan.file1, plan.file2, plan.file1.region, plan.file2.region, options);
+    }
+}
+
+bool progressiveMove(const fs::path& source, const fs::path& dest, const FileStat& sourceStat,
+                     const SwapOptions& options);
+
+// Move a file to its destination by renaming it. A rename that crosses
+// filesystems (EXDEV: an explicit --1-to/--2-to on another mount, or a bind
+// mount of the same device) falls back to a progressive move of the data.
+bool moveToDestination(const fs::path& from, const fs::path& to, const SwapOptions& options) {
+    boost::system::error_code ec;
+    fs::rename(from, to, ec);
+    if (!ec) {
+        if (!noteRename(options, from, to)) {
+            std::cerr << "Error: Unable to flush the move of " << from.string() << " to disk." << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (ec != boost::system::errc::cross_device_link) {
+        std::cerr << "Error: Unable to move " << from.string() << " to " << to.string() << ": " << ec.message()
+                  << std::endl;
+        return false;
+    }
+    if (options.verbose) {
+        std::cout << to.string() << " is on another filesystem; moving the data." << std::endl;
+    }
+    return progressiveMove(from, to, statPath(from), options);
+}
+
+// Carry out a plan: create directories, confirm overwrites, then swap
+int executeSwapPlan(const SwapPlan& plan, const YesActions& yesActions, const SwapOptions& planOptions) {
+    SwapOptions options = planOptions;
+    options.inPlace = plan.inPlace;
+    options.regionA = plan.file1.region;
+    options.regionB = plan.file2.region;
+    const fs::path& pathA = plan.file1.source;
+    const fs::path& pathB = plan.file2.source;
+    const fs::path& destA = plan.file1.destination;
+    const fs::path& destB = plan.file2.destination;
+    bool verbose = options.verbose;
+
+    // Check and handle directory creation
+    for (const PlannedFile* file : {&plan.file1, &plan.file2}) {
+        if (!file->createDir) continue;
+        fs::path destDir = file->destination.parent_path();
+        if (fs::exists(destDir)) continue;  // Both destinations may share a new directory
+
+        bool shouldCreate = yesActions.shouldAutoMkdir();
+        if (!shouldCreate) {
+            shouldCreate = promptYesNo("Directory " + destDir.string() + " does not exist. Create it?");
+        }
+        if (shouldCreate) {
+            fs::create_directories(destDir);
+            if (verbose) {
+                std::cout << "Created directory: " << destDir.string() << std::endl;
+            }
+        } else {
+            std::cerr << "Error: Directory does not exist: " << destDir.string() << std::endl;
+            return 1;
+        }
+    }
+
+    // Check for destination file conflicts (files that exist and aren't the source files)
+    for (const PlannedFile* file : {&plan.file1, &plan.file2}) {
+        if (!file->overwrite) continue;
+        bool shouldOverwrite = yesActions.shouldAutoOverwrite();
+        if (!shouldOverwrite) {
+            shouldOverwrite = promptYesNo("File " + file->destination.string() + " already exists. Overwrite?");
+        }
+        if (!shouldOverwrite) {
+            std::cerr << "Error: Destination file exists: " << file->destination.string() << std::endl;
+            return 1;
+        }
+    }
+
+    // Always show destinations when paths are changing (not just verbose mode)
+    if (plan.pathsChanging) {
+        std::cout << "Swapping:" << std::endl;
+        std::cout << "  " << pathA.filename().string() << " -> " << destA.string() << std::endl;
+        std::cout << "  " << pathB.filename().string() << " -> " << destB.string() << std::endl;
+    }
+
+    // Perform the operation
+    if (verbose) {
+        std::cout << "Strategy: " << plan.strategyName() << std::endl;
+    }
+
+    if (plan.method == SwapMethod::RENAME) {
+        // Same filesystem - swap the names instead of the data.
+        // Exchange pathA <-> pathB (one atomic operation where supported), so pathA
+        // now holds B's content and pathB holds A's, then move them to destinations.
+        try {
+            XMV_TRACE_SPAN("rename", 0);
+            if (destA == pathB || destB == pathA) {
+                // A destination is the other source; go through temporary names
+                fs::path tempA = pathA.string() + ".xmv_temp";
+                fs::path tempB = pathB.string() + ".xmv_temp";
+                fs::rename(pathA, tempA);
+                fs::rename(pathB, tempB);
+                fs::rename(tempA, destB);  // A's content goes to destB (swap)
+                fs::rename(tempB, destA);  // B's content goes to destA (swap)
+            } else {
+                renameSwap(pathA, pathB, verbose);
+                if (destA != pathA) fs::rename(pathA, destA);  // B's content goes to destA
+                if (destB != pathB) fs::rename(pathB, destB);  // A's content goes to destB
+            }
+        } catch (const fs::filesystem_error& err) {
+            std::cerr << "Error: " << err.what() << std::endl;
+            return 1;
+        }
+        if (!noteRename(options, pathA, destB) || !noteRename(options, pathB, destA)) {
+            std::cerr << "Error: Unable to flush the renames to disk." << std::endl;
+            return 1;
+        }
+
+        if (verbose) {
+            std::cout << "Swap completed:" << std::endl;
+            std::cout << "  " << pathA.filename().string() << " -> " << destB.string() << std::endl;
+            std::cout << "  " << pathB.filename().string() << " -> " << destA.string() << std::endl;
+        }
+    } else if (!plan.pathsChanging) {
+        // No path changes - use original XOR swap
+        if (!xorSwap(pathA.string(), pathB.string(), plan.file1.stat, plan.file2.stat, options)) {
+            return 1;
+        }
+    } else {
+        // Cross-drive with path changes - use XOR swap then rename
+        // First do XOR swap in place
+        if (!xorSwap(pathA.string(), pathB.string(), plan.file1.stat, plan.file2.stat, options)) {
+            return 1;
+        }
+
+        // Then move to final destinations if different
+        boost::system::error_code ec;
+        if (destA != pathA) {
+            if (plan.file1.overwrite) fs::remove(destA, ec);
+            if (!moveToDestination(pathA, destA, options)) return 1;
+        }
+        if (destB != pathB) {
+            if (plan.file2.overwrite) fs::remove(destB, ec);
+            if (!moveToDestination(pathB, destB, options)) return 1;
+        }
+
+        if (verbose) {
+            std::cout << "Files moved to destinations:" << std::endl;
+            std::cout << "  " << destA.string() << std::endl;
+            std::cout << "  " << destB.string() << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Move a file to another filesystem without ever holding two full copies.
+// The destination is created sparse at full size as "<dest>.xmv_partial" and
+// filled from the end backwards; once a chunk is durable at the destination,
+// the source is truncated below it. Peak usage across both devices is the file
+// size plus one chunk. If interrupted, the source holds the head of the file
+// and the partial file the tail at the same offsets, and rerunning resumes.
+// Before the first byte moves, the source's original size, mtime, identity
+// and permissions are stored durably in "<dest>.xmv_origin"; a resume only
+// continues a partial file whose record matches the source.
+
+// The source of a progressive move as it was before any truncation
+struct MoveOrigin {
+    std::uint64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    unsigned permissions = 0;
+
+    // Truncation keeps the device and inode; the size may only have shrunk
+    bool describes(const FileStat& st) const {
+        return st.device == device && st.inode == inode && st.size <= size;
+    }
+};
+
+bool loadMoveOrigin(const fs::path& path, MoveOrigin& origin) {
+    std::ifstream in(path.string());
+    std::string magic;
+    int format = 0;
+    return static_cast<bool>(in >> magic >> format >> origin.size >> origin.mtimeNs >> origin.device >>
+                             origin.inode >> origin.permissions) &&
+           magic == "xmv-move" && format == 1;
+}
+
+// Written and synced before the source is first truncated
+bool saveMoveOrigin(const fs::path& path, const MoveOrigin& origin) {
+    {
+        std::ofstream out(path.string(), std::ios::trunc);
+        out << "xmv-move 1 " << origin.size << " " << origin.mtimeNs << " " << origin.device << " "
+            << origin.inode << " " << origin.permissions << "\n";
+        if (!out.flush()) return false;
+    }
+    RawFile file(path.string(), RawFile::Mode::READ_WRITE);
+    return file.isOpen() && file.sync();
+}
+
+bool progressiveMove(const fs::path& source, const fs::path& dest, const FileStat& sourceStat,
+                     const SwapOptions& options) {
+    fs::path partial = dest.string() + PARTIAL_MOVE_SUFFIX;
+    fs::path originPath = dest.string() + MOVE_ORIGIN_SUFFIX;
+    FileStat partialStat = statPath(partial);
+    std::uint64_t remaining = sourceStat.size;  // Bytes still held only by the source
+
+    MoveOrigin origin;
+    if (partialStat.exists) {
+        if (partialStat.isDirectory || !loadMoveOrigin(originPath, origin) || !origin.describes(sourceStat) ||
+            partialStat.size != origin.size) {
+            std::cerr << "Error: " << partial.string() << " does not belong to an interrupted move of "
+                      << source.string() << std::endl;
+            return false;
+        }
+        std::cout << "Resuming interrupted move (" << remaining << " bytes left in source)" << std::endl;
+    } else {
+        origin.size = sourceStat.size;
+        origin.mtimeNs = sourceStat.mtimeNs;
+        origin.device = sourceStat.device;
+        origin.inode = sourceStat.inode;
+        origin.permissions = static_cast<unsigned>(fs::status(source).permissions());
+    }
+
+    // The destination only ever needs room for what the source still holds
+    fs::space_info space = fs::space(dest.parent_path());
+    if (space.available < remaining) {
+        std::cerr << "Error: Insufficient space on the target drive." << std::endl;
+        return false;
+    }
+
+    if (!partialStat.exists) {
+        if (!saveMoveOrigin(originPath, origin)) {
+            std::cerr << "Error: Unable to create " << originPath.string() << std::endl;
+            boost::system::error_code ec;
+            fs::remove(originPath, ec);
+            return false;
+        }
+        RawFile create(partial.string(), RawFile::Mode::WRITE);
+        if (!create.isOpen() || !create.truncate(sourceStat.size)) {
+            std::cerr << "Error: Unable to create " << partial.string() << std::endl;
+            create.close();
+            fs::remove(partial);
+            return false;
+        }
+        // The source is truncated as chunks land, so the partial file's name must be durable first
+        if (options.sync != SyncPolicy::NONE && !syncDirectory(partial.parent_path())) {
+            std::cerr << "Error: Unable to flush " << dest.parent_path().string() << " to disk." << std::endl;
+            return false;
+        }
+    }
+
+    RawFile in(source.string(), RawFile::Mode::READ_WRITE);
+    RawFile out(partial.string(), RawFile::Mode::READ_WRITE);
+    if (!in.isOpen() || !out.isOpen()) {
+        std::cerr << "Error: Unable to open files for moving." << std::endl;
+        return false;
+    }
+
+    BufferPool& pool = sharedBufferPool();
+    std::uint64_t chunk = pool.fairShare(MOVE_CHUNK_SIZE, options.verify ? 2 : 1);
+    BufferPool::Lease buffer = pool.acquire(chunk);
+    BufferPool::Lease check;
+    if (options.verify) {
+        check = pool.acquire(chunk);
+    }
+
+    ProgressBar* progressBar = nullptr;
+    if (options.progress) {
+        progressBar = new ProgressBar((remaining + chunk - 1) / chunk);
+    }
+
+    std::string failure;
+    while (remaining > 0) {
+        // Chunks end on multiples of the chunk size, so every piece lands at its own offset
+        std::uint64_t start = (remaining - 1) / chunk * chunk;
+        std::streamsize count = static_cast<std::streamsize>(remaining - start);
+
+        if (in.readAt(buffer.data(), count, start) != count) {
+            failure = "read error";
+            break;
+        }
+        if (!out.writeAt(buffer.data(), count, start) || !out.sync()) {
+            failure = "write error";
+            break;
+        }
+        if (options.verify) {
+#if defined(POSIX_FADV_DONTNEED)
+            // Read back from the device rather than the page cache
+            posix_fadvise(out.fd(), static_cast<off_t>(start), static_cast<off_t>(count), POSIX_FADV_DONTNEED);
+#endif
+            if (out.readAt(check.data(), count, start) != count ||
+                !std::equal(buffer.data(), buffer.data() + count, check.data())) {
+                failure = "verification failed at offset " + std::to_string(start);
+                break;
+            }
+        }
+
+        // Only now is this chunk safe to drop from the source
+        if (!in.truncate(start)) {
+            failure = "unable to truncate source";
+            break;
+        }
+        remaining = start;
+
+        if (progressBar)
+            ++(*progressBar);
+    }
+
+    delete progressBar;
+    in.close();
+    out.close();
+
+    if (!failure.empty()) {
+        std::cerr << "Error: Move interrupted (" << failure << "). The first " << remaining
+                  << " bytes remain in " << source.string() << " and the rest in " << partial.string()
+                  << "; run the same command again to resume." << std::endl;
+        return false;
+    }
+
+    fs::permissions(partial, static_cast<fs::perms>(origin.permissions));
+    fs::last_write_time(partial, static_cast<std::time_t>(origin.mtimeNs / 1000000000LL));
+    fs::rename(partial, dest);
+    // The destination's name must be durable before the (now empty) source
+    // goes; until then a crash could leave only the partial file, with no
+    // source for a rerun to resume from
+    if (options.sync != SyncPolicy::NONE && !syncDirectory(dest.parent_path())) {
+        std::cerr << "Error: Unable to flush " << dest.parent_path().string() << " to disk." << std::endl;
+        return false;
+    }
+    // The origin record goes last: while it is there, a rerun recognises the
+    // emptied source as a finished move (see moveLanded())
+    fs::remove(source);
+    if (!noteRename(options, source, dest)) {
+        std::cerr << "Error: Unable to flush the move of " << source.string() << " to disk." << std::endl;
+        return false;
+    }
+    fs::remove(originPath);
+    return true;
+}
+
+// True if a progressive move of source to dest was interrupted after its
+// partial file became dest: the origin record is still there, the partial
+// file is gone, dest has the recorded size and mtime and the source is empty.
+// Such a dest is the moved file, not something to overwrite.
+bool moveLanded(const FileStat& sourceStat, const fs::path& dest) {
+    MoveOrigin origin;
+    FileStat destStat = statPath(dest);
+    return loadMoveOrigin(dest.string() + MOVE_ORIGIN_SUFFIX, origin) && origin.describes(sourceStat) &&
+           sourceStat.size == 0 && !statPath(dest.string() + PARTIAL_MOVE_SUFFIX).exists && destStat.exists &&
+           !destStat.isDirectory && destStat.size == origin.size &&
+           destStat.mtimeNs / 1000000000LL == origin.mtimeNs / 1000000000LL;
+}
 
-    file >> ss.rdbuf();
-    std::string content = ss.str();
-    
-    std::string digest(CryptoPP::SHA256::DIGESTSIZE, 0);
-    hash.CalculateDigest(reinterpret_cast<CryptoPP::byte*>(&digest[0]), reinterpret_cast<const CryptoPP::byte*>(content.data()), content.size());
+// Finish a move found by moveLanded(): drop the source, then the origin record
+bool finishLandedMove(const fs::path& source, const fs::path& dest, const SwapOptions& options) {
+    std::cout << "Finishing interrupted move: " << dest.string() << " is already complete" << std::endl;
+    fs::remove(source);
+    if (!noteRename(options, source, dest)) {
+        std::cerr << "Error: Unable to flush the move of " << source.string() << " to disk." << std::endl;
+        return false;
+    }
+    fs::remove(dest.string() + MOVE_ORIGIN_SUFFIX);
+    return true;
+}
 
-    return boost::algorithm::hex(digest);
+// Match one path component against a shell wildcard (* ? [set] [!set])
+bool wildcardMatch(const std::string& pattern, const std::string& name) {
+    size_t p = 0, n = 0;
+    size_t starP = std::string::npos, starN = 0;
+    while (n < name.size()) {
+        bool matched = false;
+        size_t nextP = p + 1;
+        if (p < pattern.size() && pattern[p] == '*') {
+            starP = p++;
+            starN = n;
+            continue;
+        }
+        if (p < pattern.size() && pattern[p] == '?') {
+            matched = true;
+        } else if (p < pattern.size() && pattern[p] == '[') {
+            size_t q = p + 1;
+            bool negate = q < pattern.size() && (pattern[q] == '!' || pattern[q] == '^');
+            if (negate) ++q;
+            bool inSet = false;
+            size_t first = q;
+            while (q < pattern.size() && (pattern[q] != ']' || q == first)) {
+                if (q + 2 < pattern.size() && pattern[q + 1] == '-' && pattern[q + 2] != ']') {
+                    inSet |= pattern[q] <= name[n] && name[n] <= pattern[q + 2];
+                    q += 3;
+                } else {
+                    inSet |= pattern[q] == name[n];
+                    ++q;
+                }
+            }
+            if (q < pattern.size()) {
+                matched = inSet != negate;
+                nextP = q + 1;
+            } else {
+                matched = pattern[p] == name[n];  // Unterminated '[' is literal
+            }
+        } else if (p < pattern.size()) {
+#ifdef _WIN32
+            matched = std::tolower(static_cast<unsigned char>(pattern[p])) ==
+                      std::tolower(static_cast<unsigned char>(name[n]));
+#else
+            matched = pattern[p] == name[n];
+#endif
+        }
+
+        if (matched) {
+            p = nextP;
+            ++n;
+        } else if (starP != std::string::npos) {
+            p = starP + 1;
+            n = ++starN;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
 }
 
-// Function to perform XOR swap of two files
-void xorSwap(const std::string& fileA, const std::string& fileB, bool secure, bool fast, bool verify, bool verbose, const std::string& logFile, bool progress) {
-    // fast mode optimization planned for v0.5.0 (issue #3)
-    (void)fast;
+bool hasWildcard(const std::string& text) {
+    return text.find_first_of("*?[") != std::string::npos;
+}
 
-    // Check if both files exist
-    if (!fs::exists(fileA) || !fs::exists(fileB)) {
-        std::cerr << "Error: One or both files do not exist." << std::endl;
-        return;
+// List the entries of each directory that match one wildcard component.
+// Directories are scanned concurrently; results keep the order of dirs.
+std::vector<fs::path> scanDirectories(const std::vector<fs::path>& dirs, const std::string& component) {
+    std::vector<std::vector<fs::path>> found(dirs.size());
+    std::atomic<size_t> next(0);
+
+    auto scan = [&]() {
+        for (size_t i = next++; i < dirs.size(); i = next++) {
+            fs::path dir = dirs[i].empty() ? fs::path(".") : dirs[i];
+            boost::system::error_code ec;
+            for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+                std::string name = it->path().filename().string();
+                // Like the shell, leading dots must be matched explicitly
+                if (name[0] == '.' && component[0] != '.') continue;
+                if (wildcardMatch(component, name)) {
+                    found[i].push_back(dirs[i] / name);
+                }
+            }
+            std::sort(found[i].begin(), found[i].end());
+        }
+    };
+
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(
+        dirs.size(), std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_SWAP_THREADS))));
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.emplace_back(scan);
+    }
+    scan();
+    for (auto& thread : threads) {
+        thread.join();
     }
 
-    // Check if there is enough space on the target drive
-    fs::path pathA(fileA);
-    fs::path pathB(fileB);
-    fs::space_info spaceB = fs::space(pathB.parent_path());
-    if (spaceB.available < fs::file_size(pathA)) {
-        std::cerr << "Error: Insufficient space on the target drive." << std::endl;
-        return;
+    std::vector<fs::path> results;
+    for (auto& list : found) {
+        results.insert(results.end(), list.begin(), list.end());
     }
+    return results;
+}
 
-    // Open log file if specified
-    std::ofstream log;
-    if (!logFile.empty()) {
-        log.open(logFile, std::ios::app);
-        if (!log) {
-            std::cerr << "Error: Unable to open log file." << std::endl;
-            return;
+// Expand a source argument the way a POSIX shell would, for shells that don't
+// (cmd.exe) and for quoted patterns. Wildcards may appear in any component.
+// Arguments without wildcards, or that name an existing file, are kept as-is.
+std::vector<fs::path> expandSourcePattern(const std::string& pattern) {
+    fs::path path(pattern);
+    if (!hasWildcard(pattern) || fs::exists(path)) {
+        return {path};
+    }
+
+    std::vector<fs::path> current = {path.root_path()};
+    for (const fs::path& component : path.relative_path()) {
+        std::string text = component.string();
+        if (text == ".") continue;
+        if (hasWildcard(text)) {
+            current = scanDirectories(current, text);
+        } else {
+            for (auto& entry : current) {
+                entry /= component;
+            }
         }
+        if (current.empty()) break;
     }
 
-    // Calculate chunk size based on secure mode
-    std::streamsize chunkSize = secure ? CHUNK_SIZE_SECURE : CHUNK_SIZE_FAST;
+    std::vector<fs::path> files;
+    for (const auto& entry : current) {
+        if (fs::is_regular_file(entry)) files.push_back(entry);
+    }
+    return files;
+}
 
-    // Open input and output files
-    std::ifstream inA(fileA, std::ios::binary);
-    std::ifstream inB(fileB, std::ios::binary);
-    std::ofstream outA(fileA + ".temp", std::ios::binary);
-    std::ofstream outB(fileB + ".temp", std::ios::binary);
+// One source of a multi-file move
+struct MoveEntry {
+    fs::path source;
+    fs::path destination;
+    FileStat stat;
+    bool sameFilesystem = false;
+    bool overwrite = false;
+    bool landed = false;    // Interrupted after its rename; only the source is left to remove
+};
 
-    // Initialize progress bar if enabled
-    ProgressBar* progressBar = nullptr;
-    if (progress)
-        progressBar = new ProgressBar(static_cast<unsigned long>(fs::file_size(pathA) / chunkSize));
+// Move files into a directory: xmv FILE... DIR/
+// Sources on the destination's filesystem are renamed first in one batch.
+// The rest are streamed one at a time by progressive truncation, grouped by
+// source device so each device is read sequentially, all drawing on the
+// shared buffer pool.
+int executeMoves(const std::vector<fs::path>& sources, const fs::path& destDir, const YesActions& yesActions,
+                 const SwapOptions& options, bool dryRun) {
+    std::vector<MoveEntry> entries;
+    std::set<fs::path> destinations;
+    for (const auto& source : sources) {
+        MoveEntry entry;
+        entry.source = source;
+        entry.stat = statPath(source);
+        if (!entry.stat.exists || entry.stat.isDirectory) {
+            std::cerr << "Error: Source file does not exist: " << source.string() << std::endl;
+            return 1;
+        }
+        if (entry.stat.isBlockDevice) {
+            std::cerr << "Error: Block devices can be swapped but not moved: " << source.string() << std::endl;
+            return 1;
+        }
 
-    // Perform XOR swap
-    std::vector<char> bufferA(chunkSize);
-    std::vector<char> bufferB(chunkSize);
+        entry.destination = destDir / source.filename();
+        if (entry.destination == source) {
+            std::cerr << "Error: Source and destination are the same file: " << source.string() << std::endl;
+            return 1;
+        }
+        if (!destinations.insert(entry.destination).second) {
+            std::cerr << "Error: More than one source would be moved to " << entry.destination.string() << std::endl;
+            return 1;
+        }
 
-    // Read both files chunk by chunk until both are exhausted
+        FileStat destStat = statPath(entry.destination);
+        if (destStat.isDirectory) {
+            std::cerr << "Error: Destination is a directory: " << entry.destination.string() << std::endl;
+            return 1;
+        }
+        entry.landed = moveLanded(entry.stat, entry.destination);
+        entry.overwrite = destStat.exists && !entry.landed;
+        entry.sameFilesystem = isSameFilesystem(source, destDir);
+        entries.push_back(entry);
+    }
+
+    // Renames first, then streams grouped by source device, in argument order within a group
+    std::stable_sort(entries.begin(), entries.end(), [](const MoveEntry& a, const MoveEntry& b) {
+        if (a.sameFilesystem != b.sameFilesystem) return a.sameFilesystem;
+        return !a.sameFilesystem && a.stat.device < b.stat.device;
+    });
+    bool createDir = !fs::exists(destDir);
+
+    if (dryRun || options.verbose) {
+        std::uint64_t lastDevice = 0;
+        bool first = true;
+        for (const auto& entry : entries) {
+            if (first || (!entry.sameFilesystem && entry.stat.device != lastDevice)) {
+                std::cout << (entry.sameFilesystem ? "Rename (same filesystem):"
+                                                   : "Stream by progressive truncation (peak usage: file size plus one chunk):")
+                          << std::endl;
+            }
+            first = false;
+            lastDevice = entry.stat.device;
+            std::cout << "  " << entry.source.string() << " -> " << entry.destination.string()
+                      << (entry.overwrite ? " (overwrite)" : entry.landed ? " (already moved; finish)" : "")
+                      << std::endl;
+        }
+        if (createDir) std::cout << "Create directory: " << destDir.string() << std::endl;
+    }
+    if (dryRun) {
+        std::cout << std::endl;
+        std::cout << "No changes made." << std::endl;
+        return 0;
+    }
+
+    if (createDir) {
+        bool shouldCreate = yesActions.shouldAutoMkdir();
+        if (!shouldCreate) {
+            shouldCreate = promptYesNo("Directory " + destDir.string() + " does not exist. Create it?");
+        }
+        if (!shouldCreate) {
+            std::cerr << "Error: Directory does not exist: " << destDir.string() << std::endl;
+            return 1;
+        }
+        fs::create_directories(destDir);
+    }
+
+    // Confirm every overwrite before anything moves
+    for (const auto& entry : entries) {
+        if (!entry.overwrite) continue;
+        bool shouldOverwrite = yesActions.shouldAutoOverwrite();
+        if (!shouldOverwrite) {
+            shouldOverwrite = promptYesNo("File " + entry.destination.string() + " already exists. Overwrite?");
+        }
+        if (!shouldOverwrite) {
+            std::cerr << "Error: Destination file exists: " << entry.destination.string() << std::endl;
+            return 1;
+        }
+    }
+
+    for (const auto& entry : entries) {
+        try {
+            if (entry.landed) {
+                if (!finishLandedMove(entry.source, entry.destination, options)) {
+                    return 1;
+                }
+            } else if (entry.sameFilesystem) {
+                if (!moveToDestination(entry.source, entry.destination, options)) {
+                    return 1;
+                }
+            } else {
+                if (entry.overwrite) fs::remove(entry.destination);
+                if (!progressiveMove(entry.source, entry.destination, entry.stat, options)) {
+                    return 1;
+                }
+            }
+        } catch (const fs::filesystem_error& err) {
+            std::cerr << "Error: " << err.what() << std::endl;
+            return 1;
+        }
+
+        if (options.verbose) {
+            std::cout << "Moved: " << entry.destination.string() << std::endl;
+        }
+    }
+    return 0;
+}
+
+// ============================================================
+// Daemon mode (--daemon SOCKET) and thin client (--client SOCKET)
+// ============================================================
+//
+// The daemon listens on a Unix domain socket and runs swap and move jobs on a
+// fixed set of runner threads, each keeping its own warm buffer pool. The
+// protocol is newline-delimited JSON; every request line is one job:
+//
+//   {"id": "job-1", "cwd": "/data", "paths": ["a.img", "b.img"],
+//    "options": {"verify": "crc32c", "threads": 4, "yes": ["mkdir"]}}
+//
+// Option names are the long CLI options without dashes: true sets a flag,
+// arrays repeat an option. "args" (the command line after "xmv", as the thin
+// client sends it) may be given instead of paths and options. Relative paths
+// resolve against "cwd". The daemon answers with one event per line:
+//
+//   {"id": "job-1", "event": "started"}
+//   {"id": "job-1", "event": "output", "stream": "stdout", "text": "..."}
+//   {"id": "job-1", "event": "done", "exit_code": 0}
+//
+// or {"id": ..., "event": "rejected", "message": ...} for a malformed request.
+
+// Limits how many jobs touch one device at a time. A job takes all of its
+// devices at once or none, so two jobs can never each hold a device the other
+// waits for, and it never waits in a runner: one that doesn't fit goes back to
+// the daemon's queue, which hands it out again once a release makes room.
+class DeviceLimiter {
+public:
+    explicit DeviceLimiter(unsigned limit) : limit_(std::max(1u, limit)) {}
+
+    // Add the devices in wanted that held lacks; all of them or none
+    bool tryAcquire(std::set<std::uint64_t>& held, const std::set<std::uint64_t>& wanted) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::uint64_t> extra;
+        for (std::uint64_t device : wanted) {
+            if (held.count(device) == 0) extra.push_back(device);
+        }
+        if (!std::all_of(extra.begin(), extra.end(),
+                         [&](std::uint64_t device) { return running_[device] < limit_; })) {
+            return false;
+        }
+        for (std::uint64_t device : extra) {
+            ++running_[device];
+            held.insert(device);
+        }
+        return true;
+    }
+
+    void release(std::set<std::uint64_t>& held) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::uint64_t device : held) --running_[device];
+        }
+        held.clear();
+        if (onRelease_) onRelease_();
+    }
+
+    // Called after every release, so a queue can retry the jobs that didn't fit
+    void onRelease(std::function<void()> callback) { onRelease_ = std::move(callback); }
+
+private:
+    unsigned limit_;
+    std::mutex mutex_;
+    std::map<std::uint64_t, unsigned> running_;
+    std::function<void()> onRelease_;
+};
+
+// What a command run by the daemon needs to know about its job
+struct JobContext {
+    fs::path cwd;                       // Client's working directory
+    DeviceLimiter* devices = nullptr;
+    std::set<std::uint64_t> held;       // Devices reserved for the job
+    std::set<std::uint64_t> wanted;     // Devices it needed when it last didn't fit
+    std::function<void()> admitted;     // Called once the job holds its devices
+};
+
+// runCommand() result for a daemon job whose devices are busy; its runner
+// puts it back in the queue instead of waiting
+const int JOB_DEFERRED = -2;
+
+// Device of a path, or of its nearest existing parent (for destinations)
+std::uint64_t deviceOfPath(fs::path path) {
+    while (!path.empty()) {
+        FileStat st = statPath(path);
+        if (st.exists) return st.device;
+        path = path.parent_path();
+    }
+    return 0;
+}
+
+// Reserve every device the paths live on for the job, without waiting.
+// False if one of them already runs its limit of jobs; always true outside the daemon.
+bool admitJob(JobContext* job, const std::vector<fs::path>& paths) {
+    if (!job || !job->devices) return true;
+    std::set<std::uint64_t> devices;
+    for (const auto& path : paths) {
+        devices.insert(deviceOfPath(path));
+    }
+    if (!job->devices->tryAcquire(job->held, devices)) {
+        job->wanted = devices;
+        return false;
+    }
+    if (job->admitted) job->admitted();
+    return true;
+}
+
+int runCommand(std::vector<std::string> arguments, JobContext* job);
+
+#ifndef _WIN32
+
+std::atomic<bool> daemonStopping(false);
+
+void onDaemonSignal(int) {
+    daemonStopping = true;
+}
+
+// One client connection; jobs from it answer through the same socket
+class DaemonConnection {
+public:
+    explicit DaemonConnection(int fd) : fd_(fd) {}
+    ~DaemonConnection() { ::close(fd_); }
+
+    DaemonConnection(const DaemonConnection&) = delete;
+    DaemonConnection& operator=(const DaemonConnection&) = delete;
+
+    int fd() const { return fd_; }
+
+    // Send one event line; later events are dropped once the client has gone
+    void send(const std::string& line) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t sent = 0;
+        while (open_ && sent < line.size()) {
+            ssize_t n = ::write(fd_, line.data() + sent, line.size() - sent);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) open_ = false;
+            else sent += static_cast<size_t>(n);
+        }
+    }
+
+private:
+    int fd_;
+    std::mutex mutex_;
+    bool open_ = true;
+};
+
+std::string jobEvent(const std::string& id, const std::string& event, const std::string& fields = "") {
+    return "{\"id\": \"" + jsonEscape(id) + "\", \"event\": \"" + event + "\"" +
+           (fields.empty() ? "" : ", " + fields) + "}\n";
+}
+
+// A job's stdout or stderr, sent as "output" events a line (or progress bar
+// update) at a time. Range workers write progress too, hence the lock.
+// Output is held back until the job is admitted to its devices, so a job
+// that is put back in the queue can drop what it printed while planning.
+class JobStreamBuf : public std::streambuf {
+public:
+    JobStreamBuf(std::shared_ptr<DaemonConnection> connection, const std::string& id, const char* stream)
+        : connection_(std::move(connection)), id_(id), stream_(stream) {}
+    ~JobStreamBuf() override { release(); }
+
+    // Send held output, and everything after it as it comes
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        holding_ = false;
+        flushLocked();
+    }
+
+    void discard() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.clear();
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        char ch = traits_type::to_char_type(c);
+        xsputn(&ch, 1);
+        return c;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.append(s, static_cast<size_t>(n));
+        if (pending_.find_first_of("\n\r") != std::string::npos) flushLocked();
+        return n;
+    }
+
+    int sync() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flushLocked();
+        return 0;
+    }
+
+private:
+    void flushLocked() {
+        if (holding_ || pending_.empty()) return;
+        connection_->send(jobEvent(id_, "output", "\"stream\": \"" + std::string(stream_) + "\", \"text\": \"" +
+                                                      jsonEscape(pending_) + "\""));
+        pending_.clear();
+    }
+
+    std::shared_ptr<DaemonConnection> connection_;
+    std::string id_;
+    const char* stream_;
+    std::mutex mutex_;
+    std::string pending_;
+    bool holding_ = true;
+};
+
+struct DaemonJob {
+    std::shared_ptr<DaemonConnection> connection;
+    std::string id;
+    std::vector<std::string> arguments;
+    JobContext context;
+    bool started = false;
+};
+
+// Jobs waiting for a runner; pop() returns false once closed and drained.
+// A job put back because its devices were busy keeps its place at the front
+// and is handed out, with those devices reserved, once they have room;
+// jobs behind it that fit run in the meantime.
+class JobQueue {
+public:
+    explicit JobQueue(DeviceLimiter& devices) : devices_(devices) {
+        devices_.onRelease([this] {
+            { std::lock_guard<std::mutex> lock(mutex_); }
+            cv_.notify_all();
+        });
+    }
+
+    void push(DaemonJob job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    void retry(DaemonJob job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.insert(jobs_.begin(), std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    bool pop(DaemonJob& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto ready = jobs_.end();
+        cv_.wait(lock, [&] {
+            ready = std::find_if(jobs_.begin(), jobs_.end(), [&](DaemonJob& queued) {
+                return devices_.tryAcquire(queued.context.held, queued.context.wanted);
+            });
+            return ready != jobs_.end() || (closed_ && jobs_.empty());
+        });
+        if (ready == jobs_.end()) return false;
+        job = std::move(*ready);
+        jobs_.erase(ready);
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    DeviceLimiter& devices_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<DaemonJob> jobs_;
+    bool closed_ = false;
+};
+
+// The command line a job request stands for (without the program name)
+std::vector<std::string> jobArguments(const JsonValue& request) {
+    std::vector<std::string> arguments;
+    if (const JsonValue* args = request.find("args")) {
+        for (const auto& item : args->items) arguments.push_back(item.asString());
+        return arguments;
+    }
+    if (const JsonValue* paths = request.find("paths")) {
+        for (const auto& item : paths->items) arguments.push_back(item.asString());
+    }
+    if (const JsonValue* options = request.find("options")) {
+        for (const auto& member : options->members) {
+            std::string flag = "--" + member.first;
+            const JsonValue& value = member.second;
+            switch (value.type) {
+            case JsonValue::Type::BOOL:
+                if (value.boolean) arguments.push_back(flag);
+                break;
+            case JsonValue::Type::STRING:
+            case JsonValue::Type::NUMBER:
+                // --verify takes its algorithm attached, as on the command line
+                if (member.first == "verify") {
+                    arguments.push_back(flag + "=" + value.text);
+                } else {
+                    arguments.push_back(flag);
+                    arguments.push_back(value.text);
+                }
+                break;
+            case JsonValue::Type::ARRAY:
+                for (const auto& item : value.items) {
+                    arguments.push_back(flag);
+                    arguments.push_back(item.text);
+                }
+                break;
+            case JsonValue::Type::NUL:
+                break;
+            default:
+                throw std::runtime_error("option \"" + member.first + "\" has an unsupported value");
+            }
+        }
+    }
+    return arguments;
+}
+
+// Read request lines from one client and queue them as jobs
+void serveConnection(std::shared_ptr<DaemonConnection> connection, JobQueue& queue, DeviceLimiter& devices,
+                     std::atomic<std::uint64_t>& jobCounter) {
+    std::string buffer;
+    char chunk[4096];
     while (true) {
-        inA.read(bufferA.data(), chunkSize);
-        std::streamsize countA = inA.gcount();
+        ssize_t n = ::read(connection->fd(), chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buffer.append(chunk, static_cast<size_t>(n));
 
-        inB.read(bufferB.data(), chunkSize);
-        std::streamsize countB = inB.gcount();
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
 
-        // Stop when both files are exhausted
-        if (countA == 0 && countB == 0)
-            break;
+            DaemonJob job;
+            job.connection = connection;
+            job.id = "job-" + std::to_string(++jobCounter);
+            try {
+                JsonValue request = JsonParser(line).parse();
+                if (const JsonValue* id = request.find("id")) job.id = id->asString();
+                job.arguments = jobArguments(request);
+                if (const JsonValue* cwd = request.find("cwd")) job.context.cwd = fs::path(cwd->asString());
+            } catch (const std::runtime_error& err) {
+                connection->send(jobEvent(job.id, "rejected", "\"message\": \"" + jsonEscape(err.what()) + "\""));
+                continue;
+            }
+            if (job.context.cwd.empty() || !job.context.cwd.is_absolute()) {
+                connection->send(jobEvent(job.id, "rejected", "\"message\": \"cwd must be an absolute path\""));
+                continue;
+            }
+            job.context.devices = &devices;
+            queue.push(std::move(job));
+        }
+    }
+}
+
+// Run queued jobs until the queue closes, with output routed to each job's client
+void runJobs(JobQueue& queue, std::uint64_t budget, bool hugePages, bool verbose) {
+    BufferPool pool(budget);
+    pool.configure(budget, hugePages);
+    jobBufferPool = &pool;
+
+    DaemonJob job;
+    while (queue.pop(job)) {
+        if (!job.started) {
+            if (verbose) std::cout << "[" << job.id << "] started" << std::endl;
+            job.connection->send(jobEvent(job.id, "started"));
+            job.started = true;
+        }
+
+        int exitCode = 1;
+        {
+            JobStreamBuf out(job.connection, job.id, "stdout");
+            JobStreamBuf err(job.connection, job.id, "stderr");
+            job.context.admitted = [&out, &err] {
+                out.release();
+                err.release();
+            };
+            jobStdout = &out;
+            jobStderr = &err;
+            std::vector<std::string> arguments = {"xmv"};
+            arguments.insert(arguments.end(), job.arguments.begin(), job.arguments.end());
+            try {
+                exitCode = runCommand(arguments, &job.context);
+            } catch (const std::exception& error) {
+                std::cerr << "Error: " << error.what() << std::endl;
+            }
+            std::cout.flush();
+            jobStdout = nullptr;
+            jobStderr = nullptr;
+            job.context.admitted = nullptr;
+            if (exitCode == JOB_DEFERRED) {
+                out.discard();
+                err.discard();
+            }
+        }
+        job.context.devices->release(job.context.held);
+
+        // Busy devices: let this runner take another job meanwhile
+        if (exitCode == JOB_DEFERRED) {
+            if (verbose) std::cout << "[" << job.id << "] waiting for its devices" << std::endl;
+            queue.retry(std::move(job));
+            job = DaemonJob();
+            continue;
+        }
+
+        job.connection->send(jobEvent(job.id, "done", "\"exit_code\": " + std::to_string(exitCode)));
+        if (verbose) std::cout << "[" << job.id << "] exit " << exitCode << std::endl;
+        job = DaemonJob();  // Drop the connection reference
+    }
+    jobBufferPool = nullptr;
+}
+
+// --daemon SOCKET: serve jobs until SIGINT or SIGTERM. Running and queued
+// jobs finish before the daemon exits.
+int runDaemon(const std::string& socketPath, unsigned runners, unsigned perDevice, bool verbose) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path too long: " << socketPath << std::endl;
+        return 1;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    // A socket file nobody answers on is left over from a daemon that died
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        ::close(probe);
+        std::cerr << "Error: A daemon is already listening on " << socketPath << std::endl;
+        return 1;
+    }
+    if (probe >= 0) ::close(probe);
+    struct stat existing {};
+    if (::lstat(socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Error: " << socketPath << " exists and is not a socket" << std::endl;
+            return 1;
+        }
+        ::unlink(socketPath.c_str());
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t oldMask = ::umask(0077);  // Jobs run with the daemon's rights; only its owner may connect
+    bool bound = listener >= 0 && ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(oldMask);
+    if (!bound || ::listen(listener, 64) != 0) {
+        std::cerr << "Error: Unable to listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0) ::close(listener);
+        return 1;
+    }
+
+    struct sigaction action {};
+    action.sa_handler = onDaemonSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Route std::cout/std::cerr per thread for the lifetime of the daemon
+    RoutedStreamBuf routedOut(std::cout.rdbuf(), [] { return jobStdout; });
+    RoutedStreamBuf routedErr(std::cerr.rdbuf(), [] { return jobStderr; });
+    std::streambuf* consoleOut = std::cout.rdbuf(&routedOut);
+    std::streambuf* consoleErr = std::cerr.rdbuf(&routedErr);
+
+    // Every runner's pool gets at least the --max-memory minimum
+    std::uint64_t poolBudget = sharedBufferPool().budget();
+    if (poolBudget / runners < MIN_MAX_MEMORY) {
+        runners = static_cast<unsigned>(std::max<std::uint64_t>(poolBudget / MIN_MAX_MEMORY, 1));
+        std::cout << "Using " << runners << " runners (--max-memory too small for more)" << std::endl;
+    }
+    std::uint64_t budget = std::max<std::uint64_t>(poolBudget / runners, MIN_MAX_MEMORY);
+    DeviceLimiter devices(perDevice);
+    JobQueue queue(devices);
+    std::atomic<std::uint64_t> jobCounter(0);
+
+    std::vector<std::thread> runnerThreads;
+    for (unsigned i = 0; i < runners; ++i) {
+        runnerThreads.emplace_back(runJobs, std::ref(queue), budget, sharedBufferPool().hugePages(), verbose);
+    }
+
+    std::cout << "xmv daemon listening on " << socketPath << " (" << runners << " runners, " << perDevice
+              << " job(s) per device)" << std::endl;
+
+    // One reader thread per open connection; readers whose client has hung up
+    // are joined in the accept loop, and the connection's descriptor closes
+    // once its last queued job has answered
+    struct Reader {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+        std::weak_ptr<DaemonConnection> connection;
+    };
+    std::vector<Reader> readers;
+    auto reapReaders = [&readers]() {
+        for (auto it = readers.begin(); it != readers.end();) {
+            if (*it->done) {
+                it->thread.join();
+                it = readers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    while (!daemonStopping) {
+        reapReaders();
+        pollfd waitFor{listener, POLLIN, 0};
+        int ready = ::poll(&waitFor, 1, 500);
+        if (ready <= 0) continue;
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+        auto connection = std::make_shared<DaemonConnection>(client);
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([connection, done, &queue, &devices, &jobCounter]() {
+            serveConnection(connection, queue, devices, jobCounter);
+            *done = true;
+        });
+        readers.push_back(Reader{std::move(thread), done, connection});
+    }
+
+    std::cout << "xmv daemon stopping; finishing queued jobs." << std::endl;
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+
+    // Stop reading new requests, then let the runners drain the queue
+    for (const auto& reader : readers) {
+        if (auto connection = reader.connection.lock()) ::shutdown(connection->fd(), SHUT_RD);
+    }
+    for (auto& reader : readers) reader.thread.join();
+    queue.close();
+    for (auto& runner : runnerThreads) runner.join();
+
+    std::cout.rdbuf(consoleOut);
+    std::cerr.rdbuf(consoleErr);
+    return 0;
+}
+
+// --client SOCKET: send this command line to a daemon and relay its output
+int runClient(const std::string& socketPath, const std::vector<std::string>& arguments) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path too long: " << socketPath << std::endl;
+        return 1;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
 
-        // Process up to the larger count for XOR (zero-pad shorter in memory only)
-        std::streamsize maxCount = std::max(countA, countB);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Error: No daemon listening on " << socketPath << std::endl;
+        if (fd >= 0) ::close(fd);
+        return 1;
+    }
 
-        // Zero-pad in memory if one file is shorter (for XOR operation only)
-        if (countA < maxCount)
-            std::fill(bufferA.begin() + countA, bufferA.begin() + maxCount, 0);
-        if (countB < maxCount)
-            std::fill(bufferB.begin() + countB, bufferB.begin() + maxCount, 0);
+    std::string request = "{\"cwd\": \"" + jsonEscape(fs::current_path().string()) + "\", \"args\": [";
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        request += (i ? ", \"" : "\"") + jsonEscape(arguments[i]) + "\"";
+    }
+    request += "]}\n";
+    signal(SIGPIPE, SIG_IGN);
+    DaemonConnection connection(fd);
+    connection.send(request);
+    ::shutdown(fd, SHUT_WR);
 
-        // XOR swap the buffers
-        for (std::streamsize i = 0; i < maxCount; ++i) {
-            char temp = bufferA[i] ^ bufferB[i];
-            bufferA[i] ^= temp;
-            bufferB[i] ^= temp;
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            try {
+                JsonValue event = JsonParser(line).parse();
+                std::string kind = event.at("event").asString();
+                if (kind == "output") {
+                    std::ostream& out = event.at("stream").asString() == "stderr" ? std::cerr : std::cout;
+                    out << event.at("text").asString() << std::flush;
+                } else if (kind == "done") {
+                    return static_cast<int>(event.at("exit_code").asInt());
+                } else if (kind == "rejected") {
+                    std::cerr << "Error: Daemon rejected the job: " << event.at("message").asString() << std::endl;
+                    return 1;
+                }
+            } catch (const std::runtime_error& err) {
+                std::cerr << "Error: Bad reply from daemon: " << err.what() << std::endl;
+                return 1;
+            }
         }
 
-        // Write swapped content with original sizes (bufferA now has B's content, bufferB has A's)
-        outA.write(bufferA.data(), countB);
-        outB.write(bufferB.data(), countA);
-
-        if (progress && progressBar)
-            ++(*progressBar);
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buffer.append(chunk, static_cast<size_t>(n));
     }
+    std::cerr << "Error: Daemon closed the connection before the job finished." << std::endl;
+    return 1;
+}
 
-    // Close files
-    inA.close();
-    inB.close();
-    outA.close();
-    outB.close();
+#else
 
-    // Verify file integrity if enabled
-    if (verify) {
-        std::string hashA = calculateSHA256(fileA + ".temp");
-        std::string hashB = calculateSHA256(fileB + ".temp");
+int runDaemon(const std::string&, unsigned, unsigned, bool) {
+    std::cerr << "Error: --daemon needs Unix domain sockets (Linux/macOS)." << std::endl;
+    return 1;
+}
 
-        if (hashA != calculateSHA256(fileB) || hashB != calculateSHA256(fileA)) {
-            std::cerr << "Error: File integrity check failed." << std::endl;
-            fs::remove(fileA + ".temp");
-            fs::remove(fileB + ".temp");
-            return;
-        }
-    }
+int runClient(const std::string&, const std::vector<std::string>&) {
+    std::cerr << "Error: --client needs Unix domain sockets (Linux/macOS)." << std::endl;
+    return 1;
+}
 
-    // Replace original files with swapped files
-    // After XOR swap: fileA.temp has B's content, fileB.temp has A's content
-    // So we rename each temp back to its original filename to complete the swap
-    fs::rename(fileA + ".temp", fileA);
-    fs::rename(fileB + ".temp", fileB);
+#endif
 
-    // Log success message if verbose mode is enabled
-    if (verbose) {
-        std::string message = "XOR swap completed successfully.";
-        std::cout << message << std::endl;
-        if (log)
-            log << message << std::endl;
+// Group commit at the end of a run (--sync=end). It runs even when the run
+// failed part way: earlier files may already have replaced their originals,
+// and their directory entries must still reach the disk. The run's own error
+// comes first.
+int finishSync(SyncBatch& batch, int result) {
+    if (!batch.flush()) {
+        std::cerr << "Error: Unable to flush renamed files' directories to disk." << std::endl;
+        return result != 0 ? result : 1;
     }
+    return result;
 }
 
-int main(int argc, char* argv[]) {
+// Parse and run one xmv command line. job is null for the command line xmv
+// was started with, or describes a job the daemon is running for a client.
+int runCommand(std::vector<std::string> arguments, JobContext* job) {
     argparse::ArgumentParser program("xmv", XORMOVE_VERSION_STRING);
 
-    program.add_argument("fileA")
-        .help("Path to the first file");
-
-    program.add_argument("fileB")
-        .help("Path to the second file");
+    program.add_argument("paths")
+        .help("Two files to swap, or files/wildcards to move followed by a directory")
+        .default_value(std::vector<std::string>{})
+        .nargs(argparse::nargs_pattern::any);
 
     program.add_argument("--secure")
         .help("Use secure mode with larger chunk size")
@@ -428,10 +5097,15 @@ int main(int argc, char* argv[]) {
         .implicit_value(true);
 
     program.add_argument("--verify")
-        .help("Verify file integrity after the swap")
+        .help("Verify file integrity after the swap (--verify=ALGO picks crc32c, xxh3 or sha256)")
         .default_value(false)
         .implicit_value(true);
 
+    // Filled in from --verify=ALGO below; argparse has no optional flag values
+    program.add_argument("--verify-algorithm")
+        .help("Checksum for --verify: crc32c, xxh3 or sha256 (default)")
+        .default_value(std::string("sha256"));
+
     program.add_argument("-vb", "--verbose")
         .help("Enable verbose output")
         .default_value(false)
@@ -446,11 +5120,95 @@ int main(int argc, char* argv[]) {
         .default_value(false)
         .implicit_value(true);
 
+    program.add_argument("--strategy")
+        .help("Swap strategy: auto (exchange on same filesystem, else XOR), exchange, xor, or inplace")
+        .default_value(std::string("auto"));
+
+    program.add_argument("--threads")
+        .help("Swap a large pair with N range workers using positional I/O (default 1)")
+        .default_value(std::string("1"));
+
+    program.add_argument("--checksum-cache")
+        .help("Keep per-chunk digests between runs: off (default), xattr or sidecar")
+        .default_value(std::string("off"));
+
+    program.add_argument("--slack")
+        .help("Extra space per device an in-place swap may use for its journal (default 16M)")
+        .default_value(std::string("16M"));
+
+    program.add_argument("--large-extents")
+        .help("Stage large extents per file: auto (when both files share a spinning disk), on, off")
+        .default_value(std::string("auto"));
+
+    program.add_argument("--physical-order")
+        .help("Swap chunks in on-disk order of fragmented inputs (Linux FIEMAP; temp-copy swaps)")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--sparse")
+        .help("Leave all-zero blocks of the swapped files as holes instead of writing them")
+        .default_value(false)
+        .implicit_value(true);
+
+    program.add_argument("--sync")
+        .help("Durability: none, end (sync data before renames, directories once per run; default) or paranoid")
+        .default_value(std::string("end"));
+
+    program.add_argument("--journal-dir")
+        .help("Directory for the journal of an in-place swap of block devices (required for them)")
+        .default_value(std::string(""));
+
+    program.add_argument("--range-a")
+        .help("Swap only this byte range of file 1, OFF:LEN (e.g. 1M:512K), in place; needs --range-b")
+        .default_value(std::string(""));
+
+    program.add_argument("--range-b")
+        .help("Byte range of file 2 to swap with --range-a, OFF:LEN (same length)")
+        .default_value(std::string(""));
+
+    program.add_argument("--trace")
+        .help("Write a Chrome trace-event timeline of reads, XOR, writes, hashing and renames to FILE")
+        .default_value(std::string(""));
+
+    program.add_argument("--simulate")
+        .help("Benchmark the swap engine on a simulated device instead of files, e.g. "
+              "bandwidth=150M,latency=4ms,queue=1,seek=8ms")
+        .default_value(std::string(""));
+
+    program.add_argument("--sim-size")
+        .help("With --simulate, sizes of the two in-memory files: SIZE or SIZE_A,SIZE_B (default 64M)")
+        .default_value(std::string("64M"));
+
+    program.add_argument("--cache-policy")
+        .help("Page cache policy: normal, or stream (sequential hints, bounded dirty pages)")
+        .default_value(std::string("normal"));
+
+    program.add_argument("--writeback")
+        .help("With --cache-policy stream, push writeback every SIZE bytes (e.g. 64M)")
+        .default_value(std::string(""));
+
+    program.add_argument("--max-memory")
+        .help("Memory budget for all I/O buffers (e.g. 64M)")
+        .default_value(std::string("64M"));
+
+    program.add_argument("--hugepages")
+        .help("Back large buffers with huge pages when available")
+        .default_value(false)
+        .implicit_value(true);
+
     program.add_argument("--dry-run")
         .help("Show what would happen without making changes")
         .default_value(false)
         .implicit_value(true);
 
+    program.add_argument("--plan-out")
+        .help("With --dry-run, write the swap plan as JSON to FILE")
+        .default_value(std::string(""));
+
+    program.add_argument("--plan-in")
+        .help("Execute a plan written by --plan-out (sources must be unchanged)")
+        .default_value(std::string(""));
+
     // Path preservation options
     program.add_argument("--1-to")
         .help("Destination for file 1 (REL, SAME-AS-1, SAME-AS-2, or /path)")
@@ -465,271 +5223,330 @@ int main(int argc, char* argv[]) {
         .default_value(std::vector<std::string>{})
         .append();
 
-    try {
-        program.parse_args(argc, argv);
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << err.what() << std::endl;
-        std::cerr << program;
-        std::exit(1);
-    }
-
-    std::string fileA = program.get<std::string>("fileA");
-    std::string fileB = program.get<std::string>("fileB");
-    bool secure = program.get<bool>("--secure");
-    bool fast = program.get<bool>("--fast");
-    bool verify = program.get<bool>("--verify");
-    bool verbose = program.get<bool>("--verbose");
-    std::string logFile = program.get<std::string>("--log");
-    bool progress = program.get<bool>("--progress");
-    bool dryRun = program.get<bool>("--dry-run");
-
-    // Path preservation options
-    std::string dest1Str = program.get<std::string>("--1-to");
-    std::string dest2Str = program.get<std::string>("--2-to");
-    auto yesArgs = program.get<std::vector<std::string>>("--yes");
-    YesActions yesActions = parseYesActions(yesArgs);
+    program.add_argument("--daemon")
+        .help("Serve swap and move jobs on the Unix socket SOCKET until interrupted")
+        .default_value(std::string(""));
 
-    fs::path pathA = fs::absolute(fs::path(fileA));
-    fs::path pathB = fs::absolute(fs::path(fileB));
+    program.add_argument("--daemon-jobs")
+        .help("With --daemon, jobs run at once, each with a warm share of --max-memory (default 4)")
+        .default_value(std::string("4"));
 
-    // Check if source files are on different drives
-    bool crossDrive = !isSameFilesystem(pathA, pathB);
+    program.add_argument("--device-jobs")
+        .help("With --daemon, jobs allowed on one device at a time (default 1)")
+        .default_value(std::string("1"));
 
-    // Determine default strategy:
-    // - Cross-drive: default to REL (move files to other drive with same relative path)
-    // - Same-drive: default to SAME (swap contents in place)
-    PathStrategy defaultStrategy = crossDrive ? PathStrategy::REL : PathStrategy::SAME;
+    program.add_argument("--client")
+        .help("Run this command in the daemon listening on SOCKET and stream its output")
+        .default_value(std::string(""));
 
-    // Parse destination specs
-    DestinationSpec dest1, dest2;
-    if (dest1Str.empty()) {
-        dest1.strategy = defaultStrategy;
-    } else {
-        dest1 = parseDestination(dest1Str, 1);
-    }
-    if (dest2Str.empty()) {
-        dest2.strategy = defaultStrategy;
-    } else {
-        dest2 = parseDestination(dest2Str, 2);
+    // --client SOCKET forwards the rest of the command line untouched
+    for (size_t i = 1; i + 1 < arguments.size() && !job; ++i) {
+        if (arguments[i] == "--client") {
+            std::string socketPath = arguments[i + 1];
+            arguments.erase(arguments.begin() + static_cast<std::ptrdiff_t>(i),
+                            arguments.begin() + static_cast<std::ptrdiff_t>(i) + 2);
+            return runClient(socketPath, std::vector<std::string>(arguments.begin() + 1, arguments.end()));
+        }
     }
 
-    // Check if source files exist
-    bool existsA = fs::exists(pathA);
-    bool existsB = fs::exists(pathB);
-
-    if (!existsA || !existsB) {
-        std::cerr << "Error: One or both files do not exist." << std::endl;
-        if (!existsA) std::cerr << "  Missing: " << fileA << std::endl;
-        if (!existsB) std::cerr << "  Missing: " << fileB << std::endl;
-        return 1;
+    // --help and --version print and exit, which would take the daemon down
+    if (job) {
+        for (size_t i = 1; i < arguments.size(); ++i) {
+            if (arguments[i] == "-h" || arguments[i] == "--help" || arguments[i] == "-v" || arguments[i] == "--version") {
+                std::cerr << "Error: " << arguments[i] << " can't be used in a daemon job." << std::endl;
+                return 1;
+            }
+        }
     }
 
-    // Resolve destination paths
-    // Note: For SAME-AS-1/SAME-AS-2, we need to pass the correct "other" file
-    fs::path destA, destB;
+    // --verify=ALGO becomes --verify --verify-algorithm ALGO, keeping plain
+    // --verify a flag that never swallows the path after it. Arguments after
+    // "--" are paths and stay as they are.
+    for (size_t i = 1; i < arguments.size(); ++i) {
+        if (arguments[i] == "--") break;
+        if (arguments[i].compare(0, 9, "--verify=") == 0) {
+            std::string algorithm = arguments[i].substr(9);
+            arguments[i] = "--verify";
+            arguments.insert(arguments.begin() + static_cast<std::ptrdiff_t>(i) + 1,
+                             {"--verify-algorithm", algorithm});
+            i += 2;
+        } else if (arguments[i].compare(0, 7, "--sync=") == 0) {
+            std::string policy = arguments[i].substr(7);
+            arguments[i] = "--sync";
+            arguments.insert(arguments.begin() + static_cast<std::ptrdiff_t>(i) + 1, policy);
+            ++i;
+        }
+    }
 
-    // For file 1: if using SAME-AS-2, the "other" file is file 2
-    if (dest1.strategy == PathStrategy::SAME_AS_2) {
-        destA = resolveDestination(pathA, pathB, dest1, 1);
-    } else {
-        destA = resolveDestination(pathA, pathB, dest1, 1);
+    try {
+        program.parse_args(arguments);
+    }
+    catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return 1;
     }
 
-    // For file 2: if using SAME-AS-1, the "other" file is file 1
-    if (dest2.strategy == PathStrategy::SAME_AS_1) {
-        destB = resolveDestination(pathB, pathA, dest2, 2);
-    } else {
-        destB = resolveDestination(pathB, pathA, dest2, 2);
+    // Options that belong to the daemon process, not to one of its jobs
+    if (job) {
+        for (const char* option : {"--daemon", "--daemon-jobs", "--device-jobs", "--client", "--trace",
+                                   "--max-memory", "--hugepages"}) {
+            if (program.is_used(option)) {
+                std::cerr << "Error: " << option << " can't be used in a daemon job." << std::endl;
+                return 1;
+            }
+        }
     }
 
-    auto sizeA = fs::file_size(pathA);
-    auto sizeB = fs::file_size(pathB);
+    // Relative paths in a daemon job are relative to the client's directory
+    auto resolve = [job](const std::string& path) {
+        return job && !path.empty() ? fs::absolute(fs::path(path), job->cwd).string() : path;
+    };
 
-    // Determine operation strategy
-    bool sameDrive = isSameFilesystem(destA, destB);
-    bool pathsChanging = (destA != pathA) || (destB != pathB);
-    std::string strategyName;
-
-    if (sameDrive && !pathsChanging) {
-        strategyName = "Rename swap (atomic, same drive)";
-    } else if (sameDrive) {
-        strategyName = "Rename with path change (same drive)";
-    } else {
-        strategyName = "XOR swap (cross-drive)";
+    auto paths = program.get<std::vector<std::string>>("paths");
+    for (auto& path : paths) {
+        path = resolve(path);
+    }
+    bool secure = program.get<bool>("--secure");
+    bool fast = program.get<bool>("--fast");
+    bool verify = program.get<bool>("--verify");
+    if (program.is_used("--verify-algorithm") && !verify) {
+        std::cerr << "Error: --verify-algorithm has no effect without --verify (use --verify=ALGO)." << std::endl;
+        return 1;
     }
+    bool verbose = program.get<bool>("--verbose");
+    std::string logFile = resolve(program.get<std::string>("--log"));
+    bool progress = program.get<bool>("--progress");
+    bool dryRun = program.get<bool>("--dry-run");
 
-    // Dry run mode - show what would happen without making changes
-    if (dryRun) {
-        std::cout << "Dry run - no changes will be made\n" << std::endl;
+    SwapOptions swapOptions;
+    swapOptions.secure = secure;
+    swapOptions.fast = fast;
+    swapOptions.verify = verify;
+    swapOptions.verbose = verbose;
+    swapOptions.logFile = logFile;
+    swapOptions.progress = progress;
+    swapOptions.physicalOrder = program.get<bool>("--physical-order");
+    swapOptions.sparse = program.get<bool>("--sparse");
 
-        std::cout << "Source files:" << std::endl;
-        std::cout << "  File 1: " << pathA.string() << " (" << sizeA << " bytes)" << std::endl;
-        std::cout << "  File 2: " << pathB.string() << " (" << sizeB << " bytes)" << std::endl;
-        std::cout << std::endl;
+    try {
+        swapOptions.cache = parseCachePolicy(program.get<std::string>("--cache-policy"),
+                                             program.get<std::string>("--writeback"));
 
-        std::cout << "Destinations:" << std::endl;
-        std::cout << "  File 1 -> " << destA.string();
-        if (destA == pathA) {
-            std::cout << " (unchanged)";
-        }
-        std::cout << std::endl;
-        std::cout << "  File 2 -> " << destB.string();
-        if (destB == pathB) {
-            std::cout << " (unchanged)";
+        // A daemon job runs on its runner's pool, sized when the daemon started
+        if (!job) {
+            std::uint64_t maxMemory = parseByteSize(program.get<std::string>("--max-memory"));
+            if (maxMemory < MIN_MAX_MEMORY) {
+                throw std::invalid_argument("--max-memory must be at least 64K");
+            }
+            sharedBufferPool().configure(maxMemory, program.get<bool>("--hugepages"));
         }
-        std::cout << std::endl;
-        std::cout << std::endl;
 
-        // Check for potential issues
-        fs::path destDirA = destA.parent_path();
-        fs::path destDirB = destB.parent_path();
-        bool needsMkdirA = !fs::exists(destDirA);
-        bool needsMkdirB = !fs::exists(destDirB);
-        bool destExistsA = fs::exists(destA) && destA != pathA && destA != pathB;
-        bool destExistsB = fs::exists(destB) && destB != pathA && destB != pathB;
+        std::string threadsText = program.get<std::string>("--threads");
+        if (threadsText.empty() || threadsText.size() > 3 ||
+            !std::all_of(threadsText.begin(), threadsText.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            throw std::invalid_argument("Invalid thread count: " + threadsText);
+        }
+        unsigned long threads = std::stoul(threadsText);
+        if (threads < 1 || threads > MAX_SWAP_THREADS) {
+            throw std::invalid_argument("--threads must be between 1 and " + std::to_string(MAX_SWAP_THREADS));
+        }
+        swapOptions.threads = static_cast<unsigned>(threads);
+        swapOptions.checksums = parseChecksumStore(program.get<std::string>("--checksum-cache"));
 
-        if (needsMkdirA || needsMkdirB || destExistsA || destExistsB) {
-            std::cout << "Actions required:" << std::endl;
-            if (needsMkdirA) {
-                std::cout << "  - Create directory: " << destDirA.string() << " (--yes mkdir)" << std::endl;
-            }
-            if (needsMkdirB) {
-                std::cout << "  - Create directory: " << destDirB.string() << " (--yes mkdir)" << std::endl;
-            }
-            if (destExistsA) {
-                std::cout << "  - Overwrite existing: " << destA.string() << " (--yes overwrite)" << std::endl;
-            }
-            if (destExistsB) {
-                std::cout << "  - Overwrite existing: " << destB.string() << " (--yes overwrite)" << std::endl;
-            }
-            std::cout << std::endl;
+        swapOptions.extents = parseExtentMode(program.get<std::string>("--large-extents"));
+        if (swapOptions.extents == ExtentMode::ON && swapOptions.threads > 1) {
+            throw std::invalid_argument("--large-extents on streams with one worker; it can't be combined with --threads");
         }
+        swapOptions.verifyAlgorithm = parseVerifyAlgorithm(program.get<std::string>("--verify-algorithm"));
+        swapOptions.sync = parseSyncPolicy(program.get<std::string>("--sync"));
+        std::string journalDir = program.get<std::string>("--journal-dir");
+        if (!journalDir.empty()) swapOptions.journalDir = fs::absolute(fs::path(resolve(journalDir)));
 
-        std::cout << "Strategy: " << strategyName << std::endl;
-        std::cout << "Chunk size: " << (secure ? "1 MB (secure)" : "4 KB (fast)") << std::endl;
-        std::cout << "Verification: " << (verify ? "Enabled" : "Disabled") << std::endl;
-        std::cout << std::endl;
-        std::cout << "No changes made." << std::endl;
+        swapOptions.slack = parseByteSize(program.get<std::string>("--slack"));
+        if (swapOptions.slack < MIN_SLACK) {
+            throw std::invalid_argument("--slack must be at least 64K");
+        }
 
-        return 0;
+        std::string rangeA = program.get<std::string>("--range-a");
+        std::string rangeB = program.get<std::string>("--range-b");
+        if (rangeA.empty() != rangeB.empty()) {
+            throw std::invalid_argument("--range-a and --range-b must be given together");
+        }
+        if (!rangeA.empty()) {
+            swapOptions.regionA = parseFileRegion(rangeA);
+            swapOptions.regionB = parseFileRegion(rangeB);
+        }
+    } catch (const std::invalid_argument& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return 1;
     }
 
-    // Check and handle directory creation
-    fs::path destDirA = destA.parent_path();
-    fs::path destDirB = destB.parent_path();
+    // Record spans from here on; the trace is written however main() returns
+    xmvtrace::Session trace(program.get<std::string>("--trace"));
+    if (!trace.ok()) {
+        std::cerr << "Error: Unable to write trace file: " << program.get<std::string>("--trace") << std::endl;
+        return 1;
+    }
 
-    if (!fs::exists(destDirA)) {
-        bool shouldCreate = yesActions.shouldAutoMkdir();
-        if (!shouldCreate) {
-            shouldCreate = promptYesNo("Directory " + destDirA.string() + " does not exist. Create it?");
+    // --daemon SOCKET serves jobs until interrupted
+    std::string daemonSocket = program.get<std::string>("--daemon");
+    if (!daemonSocket.empty()) {
+        if (!paths.empty()) {
+            std::cerr << "Error: --daemon takes no file arguments." << std::endl;
+            return 1;
         }
-        if (shouldCreate) {
-            fs::create_directories(destDirA);
-            if (verbose) {
-                std::cout << "Created directory: " << destDirA.string() << std::endl;
-            }
-        } else {
-            std::cerr << "Error: Directory does not exist: " << destDirA.string() << std::endl;
+        unsigned long runners = 0;
+        unsigned long perDevice = 0;
+        try {
+            runners = std::stoul(program.get<std::string>("--daemon-jobs"));
+            perDevice = std::stoul(program.get<std::string>("--device-jobs"));
+        } catch (const std::exception&) {
+        }
+        if (runners < 1 || runners > 256 || perDevice < 1 || perDevice > 256) {
+            std::cerr << "Error: --daemon-jobs and --device-jobs must be between 1 and 256." << std::endl;
             return 1;
         }
+        return runDaemon(daemonSocket, static_cast<unsigned>(runners), static_cast<unsigned>(perDevice), verbose);
     }
 
-    if (!fs::exists(destDirB)) {
-        bool shouldCreate = yesActions.shouldAutoMkdir();
-        if (!shouldCreate) {
-            shouldCreate = promptYesNo("Directory " + destDirB.string() + " does not exist. Create it?");
+    // --simulate runs the engine on an in-memory device; no files are involved
+    std::string simulate = program.get<std::string>("--simulate");
+    if (!simulate.empty()) {
+        if (!paths.empty()) {
+            std::cerr << "Error: --simulate takes no file arguments." << std::endl;
+            return 1;
         }
-        if (shouldCreate) {
-            fs::create_directories(destDirB);
-            if (verbose) {
-                std::cout << "Created directory: " << destDirB.string() << std::endl;
-            }
-        } else {
-            std::cerr << "Error: Directory does not exist: " << destDirB.string() << std::endl;
+        xmvio::DeviceModel model;
+        std::uint64_t simSizeA = 0;
+        std::uint64_t simSizeB = 0;
+        try {
+            model = parseDeviceModel(simulate);
+            std::string sizes = program.get<std::string>("--sim-size");
+            size_t comma = sizes.find(',');
+            simSizeA = parseByteSize(sizes.substr(0, comma));
+            simSizeB = comma == std::string::npos ? simSizeA : parseByteSize(sizes.substr(comma + 1));
+        } catch (const std::invalid_argument& err) {
+            std::cerr << "Error: " << err.what() << std::endl;
             return 1;
         }
+        return simulateSwap(model, simSizeA, simSizeB, swapOptions);
     }
 
-    // Check for destination file conflicts (files that exist and aren't the source files)
-    bool destExistsA = fs::exists(destA) && destA != pathA && destA != pathB;
-    bool destExistsB = fs::exists(destB) && destB != pathA && destB != pathB;
+    // Path preservation options
+    std::string dest1Str = program.get<std::string>("--1-to");
+    std::string dest2Str = program.get<std::string>("--2-to");
+    auto yesArgs = program.get<std::vector<std::string>>("--yes");
+    YesActions yesActions = parseYesActions(yesArgs);
 
-    if (destExistsA) {
-        bool shouldOverwrite = yesActions.shouldAutoOverwrite();
-        if (!shouldOverwrite) {
-            shouldOverwrite = promptYesNo("File " + destA.string() + " already exists. Overwrite?");
-        }
-        if (!shouldOverwrite) {
-            std::cerr << "Error: Destination file exists: " << destA.string() << std::endl;
-            return 1;
-        }
+    std::string planIn = resolve(program.get<std::string>("--plan-in"));
+    std::string planOut = resolve(program.get<std::string>("--plan-out"));
+
+    if (!planOut.empty() && !dryRun) {
+        std::cerr << "Error: --plan-out requires --dry-run." << std::endl;
+        return 1;
+    }
+    if (swapOptions.regionA.length > 0 && (!dest1Str.empty() || !dest2Str.empty() || !planIn.empty())) {
+        std::cerr << "Error: --range-a/--range-b swap in place; --1-to, --2-to and --plan-in don't apply." << std::endl;
+        return 1;
     }
 
-    if (destExistsB) {
-        bool shouldOverwrite = yesActions.shouldAutoOverwrite();
-        if (!shouldOverwrite) {
-            shouldOverwrite = promptYesNo("File " + destB.string() + " already exists. Overwrite?");
+    // A stored plan already fixes the method and destinations
+    if (!planIn.empty() && (program.is_used("--strategy") || !dest1Str.empty() || !dest2Str.empty())) {
+        std::cerr << "Error: --plan-in runs the method and destinations stored in the plan; "
+                  << "--strategy, --1-to and --2-to don't apply." << std::endl;
+        return 1;
+    }
+
+    // xmv FILE... DIR/ moves files instead of swapping two
+    if (planIn.empty() && paths.size() >= 2) {
+        const std::string& last = paths.back();
+        bool intoDirectory = last.back() == '/' || last.back() == '\\' || statPath(fs::path(last)).isDirectory;
+        if (intoDirectory) {
+            if (!planOut.empty() || !dest1Str.empty() || !dest2Str.empty() || swapOptions.regionA.length > 0) {
+                std::cerr << "Error: --plan-out, --1-to, --2-to and ranges apply to swaps, not moves." << std::endl;
+                return 1;
+            }
+
+            std::vector<fs::path> sources;
+            for (size_t i = 0; i + 1 < paths.size(); ++i) {
+                std::vector<fs::path> matches = expandSourcePattern(paths[i]);
+                if (matches.empty()) {
+                    std::cerr << "Error: No files match: " << paths[i] << std::endl;
+                    return 1;
+                }
+                for (const auto& match : matches) {
+                    sources.push_back(fs::absolute(match));
+                }
+            }
+            fs::path destDir = fs::absolute(fs::path(last));
+            std::vector<fs::path> touched = sources;
+            touched.push_back(destDir);
+            if (!admitJob(job, touched)) return JOB_DEFERRED;
+            SyncBatch syncBatch(swapOptions.sync);
+            swapOptions.syncBatch = &syncBatch;
+            int result = executeMoves(sources, destDir, yesActions, swapOptions, dryRun);
+            return finishSync(syncBatch, result);
         }
-        if (!shouldOverwrite) {
-            std::cerr << "Error: Destination file exists: " << destB.string() << std::endl;
+        if (paths.size() > 2) {
+            std::cerr << "Error: Moving several files needs a destination directory." << std::endl;
             return 1;
         }
     }
 
-    // Always show destinations when paths are changing (not just verbose mode)
-    if (pathsChanging) {
-        std::cout << "Swapping:" << std::endl;
-        std::cout << "  " << pathA.filename().string() << " -> " << destA.string() << std::endl;
-        std::cout << "  " << pathB.filename().string() << " -> " << destB.string() << std::endl;
+    std::string fileA = paths.size() > 0 ? paths[0] : std::string();
+    std::string fileB = paths.size() > 1 ? paths[1] : std::string();
+    if (planIn.empty() && (fileA.empty() || fileB.empty())) {
+        std::cerr << "Error: Two files (or --plan-in) are required." << std::endl;
+        std::cerr << program;
+        return 1;
     }
 
-    // Perform the operation
-    if (verbose) {
-        std::cout << "Strategy: " << strategyName << std::endl;
+    // Build the plan in one pass, or load a stored one and check it is still current
+    SwapPlan plan;
+    try {
+        if (!planIn.empty()) {
+            plan = readSwapPlan(planIn);
+            validateSwapPlan(plan, swapOptions);
+        } else {
+            plan = buildSwapPlan(fs::absolute(fs::path(fileA)), fs::absolute(fs::path(fileB)),
+                                 dest1Str, dest2Str, toUpperCase(program.get<std::string>("--strategy")),
+                                 swapOptions);
+        }
+    } catch (const std::runtime_error& err) {
+        std::cerr << "Error: " << err.what() << std::endl;
+        return 1;
     }
 
-    if (sameDrive && pathsChanging) {
-        // Same drive with path changes - use rename-based approach
-        // This is more efficient than XOR for same-filesystem operations
-        fs::path tempA = pathA.string() + ".xmv_temp";
-        fs::path tempB = pathB.string() + ".xmv_temp";
-
-        // Move to temps first, then to final destinations
-        fs::rename(pathA, tempA);
-        fs::rename(pathB, tempB);
-        fs::rename(tempA, destB);  // A's content goes to destB (swap)
-        fs::rename(tempB, destA);  // B's content goes to destA (swap)
+    // Dry run mode - show what would happen without making changes
+    if (dryRun) {
+        printSwapPlan(plan, swapOptions);
 
-        if (verbose) {
-            std::cout << "Swap completed:" << std::endl;
-            std::cout << "  " << pathA.filename().string() << " -> " << destB.string() << std::endl;
-            std::cout << "  " << pathB.filename().string() << " -> " << destA.string() << std::endl;
+        if (!planOut.empty()) {
+            std::ofstream out(planOut, std::ios::trunc);
+            writeSwapPlan(plan, out);
+            if (!out) {
+                std::cerr << "Error: Unable to write plan file: " << planOut << std::endl;
+                return 1;
+            }
+            std::cout << "Plan written to: " << planOut << std::endl;
         }
-    } else if (!pathsChanging) {
-        // No path changes - use original XOR swap
-        xorSwap(pathA.string(), pathB.string(), secure, fast, verify, verbose, logFile, progress);
-    } else {
-        // Cross-drive with path changes - use XOR swap then rename
-        // First do XOR swap in place
-        xorSwap(pathA.string(), pathB.string(), secure, fast, verify, verbose, logFile, progress);
 
-        // Then move to final destinations if different
-        if (destA != pathA) {
-            if (destExistsA) fs::remove(destA);
-            fs::rename(pathA, destA);
-        }
-        if (destB != pathB) {
-            if (destExistsB) fs::remove(destB);
-            fs::rename(pathB, destB);
-        }
+        std::cout << std::endl;
+        std::cout << "No changes made." << std::endl;
 
-        if (verbose) {
-            std::cout << "Files moved to destinations:" << std::endl;
-            std::cout << "  " << destA.string() << std::endl;
-            std::cout << "  " << destB.string() << std::endl;
-        }
+        return 0;
     }
 
-    return 0;
-}
\ No newline at end of file
+    if (!admitJob(job, {plan.file1.source, plan.file2.source, plan.file1.destination, plan.file2.destination})) {
+        return JOB_DEFERRED;
+    }
+    SyncBatch syncBatch(swapOptions.sync);
+    swapOptions.syncBatch = &syncBatch;
+    int result = executeSwapPlan(plan, yesActions, swapOptions);
+    return finishSync(syncBatch, result);
+}
+
+int main(int argc, char* argv[]) {
+    return runCommand(std::vector<std::string>(argv, argv + argc), nullptr);
+}
@@ -0,0 +1,93 @@
+// Unit tests for the CRC-32C used by --verify=crc32c
+// These tests check known values and that every implementation agrees
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+#include "checksums.h"
+
+// Test 1: Published check values (RFC 3720 appendix B.4 and the "123456789" check)
+bool testKnownValues() {
+    std::cout << "Test 1: Known CRC-32C values... ";
+
+    std::string check = "123456789";
+    std::vector<char> zeros(32, 0);
+    std::vector<char> ones(32, static_cast<char>(0xFF));
+    std::vector<char> ascending(32);
+    for (size_t i = 0; i < ascending.size(); ++i) ascending[i] = static_cast<char>(i);
+
+    bool success = true;
+    for (auto crc : {xmvsum::crc32c, xmvsum::crc32cSoftware}) {
+        success = success && crc(0, check.data(), check.size()) == 0xE3069283u &&
+                  crc(0, zeros.data(), zeros.size()) == 0x8A9136AAu &&
+                  crc(0, ones.data(), ones.size()) == 0x62A8AB43u &&
+                  crc(0, ascending.data(), ascending.size()) == 0x46DD794Eu &&
+                  crc(0, check.data(), 0) == 0;
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 2: The dispatched implementation matches the table at every length and alignment
+bool testImplementationsAgree() {
+    std::cout << "Test 2: Dispatched CRC-32C matches software (" << xmvsum::crc32cImplementation() << ")... ";
+
+    std::mt19937 rng(42);
+    std::vector<char> data(4096 + 16);
+    for (auto& byte : data) byte = static_cast<char>(rng());
+
+    bool success = true;
+    for (size_t start = 0; start < 16 && success; ++start) {
+        for (size_t length = 0; length <= 4096 && success; length += (length < 64 ? 1 : 61)) {
+            success = xmvsum::crc32c(0, data.data() + start, length) ==
+                      xmvsum::crc32cSoftware(0, data.data() + start, length);
+        }
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 3: Checksumming in pieces gives the same value as one pass
+bool testIncremental() {
+    std::cout << "Test 3: Incremental CRC-32C... ";
+
+    std::mt19937 rng(7);
+    std::vector<char> data(100000);
+    for (auto& byte : data) byte = static_cast<char>(rng());
+    std::uint32_t whole = xmvsum::crc32c(0, data.data(), data.size());
+
+    bool success = true;
+    for (size_t piece : {1, 3, 8, 1000, 65536}) {
+        std::uint32_t crc = 0;
+        for (size_t offset = 0; offset < data.size(); offset += piece) {
+            crc = xmvsum::crc32c(crc, data.data() + offset, std::min(piece, data.size() - offset));
+        }
+        success = success && crc == whole;
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+int main() {
+    std::cout << "=== xmv Checksum Tests ===" << std::endl;
+    std::cout << std::endl;
+
+    int passed = 0;
+    int total = 0;
+
+    total++; if (testKnownValues()) passed++;
+    total++; if (testImplementationsAgree()) passed++;
+    total++; if (testIncremental()) passed++;
+
+    std::cout << std::endl;
+    std::cout << "=== Results: " << passed << "/" << total << " tests passed ===" << std::endl;
+
+    return (passed == total) ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+// Unit tests for the simulated I/O device
+// These tests check the timing model and that replays are deterministic
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "io_backend.h"
+
+using xmvio::DeviceModel;
+using xmvio::IoFile;
+using xmvio::SimDevice;
+using xmvio::SimResult;
+
+const std::uint64_t MB = 1024 * 1024;
+
+bool near(double a, double b) {
+    return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(b));
+}
+
+DeviceModel makeModel(double bandwidth, double latency, unsigned queue, double seek) {
+    DeviceModel model;
+    model.bandwidth = bandwidth;
+    model.latency = latency;
+    model.queueDepth = queue;
+    model.seekPenalty = seek;
+    return model;
+}
+
+// Write size bytes to a new file, then forget those requests
+void createFile(SimDevice& device, const std::string& name, std::uint64_t size, char value) {
+    std::unique_ptr<IoFile> file = device.open(name, IoFile::Mode::WRITE);
+    std::vector<char> data(static_cast<size_t>(size), value);
+    file->write(data.data(), static_cast<std::streamsize>(data.size()));
+    device.clearLog();
+}
+
+// Test 1: Data written through one handle reads back through another
+bool testRoundTrip() {
+    std::cout << "Test 1: Simulated file round trip... ";
+
+    SimDevice device(makeModel(100.0 * MB, 0, 1, 0), 4 * MB);
+    std::unique_ptr<IoFile> out = device.open("f", IoFile::Mode::WRITE);
+    std::vector<char> data(10000);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<char>(i * 7);
+    bool success = out->write(data.data(), 6000) && out->writeAt(data.data() + 6000, 4000, 6000);
+
+    std::unique_ptr<IoFile> in = device.open("f", IoFile::Mode::READ);
+    std::vector<char> back(12000);
+    success = success && in->read(back.data(), 12000) == 10000 &&
+              std::equal(data.begin(), data.end(), back.begin()) &&
+              in->read(back.data(), 100) == 0;
+
+    // Truncate, and a missing file can't be opened for reading
+    success = success && out->truncate(100) && device.contents("f").size() == 100 &&
+              device.open("missing", IoFile::Mode::READ) == nullptr;
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 2: Sequential reads cost latency plus transfer time, with no seeks
+bool testSequentialTiming() {
+    std::cout << "Test 2: Sequential read timing... ";
+
+    SimDevice device(makeModel(100.0 * MB, 0.001, 1, 0.008), 16 * MB);
+    createFile(device, "f", 10 * MB, 1);
+
+    std::unique_ptr<IoFile> in = device.open("f", IoFile::Mode::READ);
+    std::vector<char> buffer(MB);
+    for (int i = 0; i < 10; ++i) {
+        in->read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+    SimResult result = device.simulate();
+
+    bool success = result.reads == 10 && result.seeks == 0 && result.bytesRead == 10 * MB &&
+                   near(result.seconds, 10 * (0.001 + 0.01));
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 3: Alternating between two files pays the seek penalty on every switch
+bool testSeekPenalty() {
+    std::cout << "Test 3: Seek penalty between files... ";
+
+    SimDevice device(makeModel(100.0 * MB, 0, 1, 0.008), 4 * MB);
+    createFile(device, "a", 4 * MB, 1);
+    createFile(device, "b", 4 * MB, 2);
+
+    std::unique_ptr<IoFile> a = device.open("a", IoFile::Mode::READ);
+    std::unique_ptr<IoFile> b = device.open("b", IoFile::Mode::READ);
+    std::vector<char> buffer(MB);
+    for (int i = 0; i < 4; ++i) {
+        a->read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        b->read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+    SimResult result = device.simulate();
+
+    // a0 b0 a1 b1 ...: every request after the first starts away from the head
+    bool success = result.reads == 8 && result.seeks == 7 && near(result.seconds, 8 * 0.01 + 7 * 0.008);
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Run `streams` threads that each read their own quarter of a file in 64 KB requests
+SimResult runStreams(unsigned queueDepth, unsigned streams) {
+    SimDevice device(makeModel(1000.0 * MB, 0.001, queueDepth, 0), 8 * MB);
+    createFile(device, "f", 8 * MB, 3);
+    std::unique_ptr<IoFile> in = device.open("f", IoFile::Mode::READ);
+
+    std::vector<std::thread> threads;
+    std::uint64_t share = 8 * MB / streams;
+    for (unsigned t = 0; t < streams; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<char> buffer(64 * 1024);
+            for (std::uint64_t offset = t * share; offset < (t + 1) * share; offset += buffer.size()) {
+                in->readAt(buffer.data(), static_cast<std::streamsize>(buffer.size()), offset);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return device.simulate();
+}
+
+// Test 4: A deeper queue hides per-request latency behind other streams' transfers
+bool testQueueDepth() {
+    std::cout << "Test 4: Queue depth overlaps latency... ";
+
+    SimResult shallow = runStreams(1, 4);
+    SimResult deep = runStreams(4, 4);
+    bool success = shallow.reads == 128 && deep.reads == 128 && deep.seconds < shallow.seconds / 2;
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 5: Replays don't depend on how the host scheduled the threads
+bool testDeterministic() {
+    std::cout << "Test 5: Multi-threaded replay is deterministic... ";
+
+    SimResult first = runStreams(2, 4);
+    bool success = true;
+    for (int run = 0; run < 10 && success; ++run) {
+        SimResult again = runStreams(2, 4);
+        success = again.seconds == first.seconds && again.seeks == first.seeks && again.reads == first.reads;
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+int main() {
+    std::cout << "=== xmv Simulated Device Tests ===" << std::endl;
+    std::cout << std::endl;
+
+    int passed = 0;
+    int total = 0;
+
+    total++; if (testRoundTrip()) passed++;
+    total++; if (testSequentialTiming()) passed++;
+    total++; if (testSeekPenalty()) passed++;
+    total++; if (testQueueDepth()) passed++;
+    total++; if (testDeterministic()) passed++;
+
+    std::cout << std::endl;
+    std::cout << "=== Results: " << passed << "/" << total << " tests passed ===" << std::endl;
+
+    return (passed == total) ? 0 : 1;
+}
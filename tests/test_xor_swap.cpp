@@ -4,11 +4,14 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <cstdio>
 #include <cstring>
 #include <cassert>
 
+#include "xor_kernels.h"
+
 // Test helper: Create a file with specific content
 bool createTestFile(const std::string& path, const std::vector<char>& content) {
     std::ofstream file(path, std::ios::binary);
@@ -30,13 +33,17 @@ std::vector<char> readFile(const std::string& path) {
     return buffer;
 }
 
-// Test helper: XOR swap two buffers (same logic as xormove)
+// Test helper: XOR swap two buffers with the kernels xormove uses
 void xorSwapBuffers(std::vector<char>& a, std::vector<char>& b) {
     size_t minSize = std::min(a.size(), b.size());
-    for (size_t i = 0; i < minSize; ++i) {
-        char temp = a[i] ^ b[i];
-        a[i] ^= temp;
-        b[i] ^= temp;
+    xorkernels::swapBuffers(a.data(), b.data(), minSize);
+}
+
+// Test helper: fill a and b with distinct patterns
+void fillPatterns(std::vector<char>& a, std::vector<char>& b) {
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = static_cast<char>((i * 31 + 7) & 0xFF);
+        b[i] = static_cast<char>((i * 17 + 3) ^ 0xA5);
     }
 }
 
@@ -152,6 +159,77 @@ bool testXorSwapLarge() {
     return success;
 }
 
+// Test 7: Every fixed-size kernel in the dispatch table
+bool testXorSwapKernelSizes() {
+    std::cout << "Test 7: XOR swap kernels for 4KB..1MB blocks... ";
+
+    bool success = true;
+    for (unsigned shift = xorkernels::MIN_BLOCK_SHIFT; shift <= xorkernels::MAX_BLOCK_SHIFT; ++shift) {
+        size_t size = size_t(1) << shift;
+        std::vector<char> a(size);
+        std::vector<char> b(size);
+        fillPatterns(a, b);
+
+        std::vector<char> origA = a;
+        std::vector<char> origB = b;
+
+        xorkernels::blockKernel(shift)(a.data(), b.data());
+        success = success && (a == origB && b == origA);
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 8: Sizes that are not a power of two, and unaligned buffers
+bool testXorSwapOddSizes() {
+    std::cout << "Test 8: XOR swap with odd sizes and offsets... ";
+
+    bool success = true;
+    const size_t sizes[] = {1, 7, 8, 9, 4095, 4097, 12288 + 5, (1 << 20) + 4096 + 3, (3 << 20) + 1};
+    for (size_t size : sizes) {
+        // One byte of offset makes the buffers unaligned for word access
+        std::vector<char> a(size + 1);
+        std::vector<char> b(size + 1);
+        fillPatterns(a, b);
+
+        std::vector<char> origA = a;
+        std::vector<char> origB = b;
+
+        xorkernels::swapBuffers(a.data() + 1, b.data() + 1, size);
+
+        // The byte before the range is untouched; the range itself is swapped
+        success = success && a[0] == origA[0] && b[0] == origB[0] &&
+                  std::equal(a.begin() + 1, a.end(), origB.begin() + 1) &&
+                  std::equal(b.begin() + 1, b.end(), origA.begin() + 1);
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
+// Test 9: Zero-block scan used by --sparse finds a single set byte anywhere
+bool testZeroScan() {
+    std::cout << "Test 9: Zero-block scan... ";
+
+    bool success = xorkernels::isZero(nullptr, 0);
+    const size_t sizes[] = {1, 8, 4095, 4096, 4097, 65536 + 3};
+    for (size_t size : sizes) {
+        std::vector<char> data(size + 1, 0);
+        success = success && xorkernels::isZero(data.data() + 1, size);
+        for (size_t at : {size_t(0), size / 2, size - 1}) {
+            data[at + 1] = 1;
+            success = success && !xorkernels::isZero(data.data() + 1, size);
+            data[at + 1] = 0;
+        }
+        data[0] = 1;  // Outside the range
+        success = success && xorkernels::isZero(data.data() + 1, size);
+    }
+
+    std::cout << (success ? "PASSED" : "FAILED") << std::endl;
+    return success;
+}
+
 int main() {
     std::cout << "=== xormove Unit Tests ===" << std::endl;
     std::cout << std::endl;
@@ -165,6 +243,9 @@ int main() {
     total++; if (testXorSwapReversible()) passed++;
     total++; if (testXorSwapEmpty()) passed++;
     total++; if (testXorSwapLarge()) passed++;
+    total++; if (testXorSwapKernelSizes()) passed++;
+    total++; if (testXorSwapOddSizes()) passed++;
+    total++; if (testZeroScan()) passed++;
 
     std::cout << std::endl;
     std::cout << "=== Results: " << passed << "/" << total << " tests passed ===" << std::endl;